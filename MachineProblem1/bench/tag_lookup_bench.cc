@@ -0,0 +1,95 @@
+// Microbenchmark: tag lookups/sec of the flat tag array (tag_match.h) against the
+// per-block scan Set::lru_hit_index did over a vector of CacheBlock.
+//
+//   make tag_lookup_bench && ./tag_lookup_bench
+
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "set.h"
+#include "tag_match.h"
+
+namespace {
+
+constexpr size_t kWays = 1 << 20;     // 8 MB of tags, like a large L2
+constexpr size_t kLookups = 1 << 23;
+
+// the old array of structures scan
+int block_hit_index(const CacheBlock *blocks, int associativity, uint64_t tag) {
+    for (int i = 0; i < associativity; i++) {
+        if (blocks[i].valid && blocks[i].tag == tag) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <typename Lookup>
+void run(const std::string &name, int associativity, Lookup lookup, uint64_t expected) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t checksum = lookup();
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    std::cout << std::format("{:<8}{:<14}{:>10.1f} M lookups/s{}", associativity, name, kLookups / seconds.count() / 1e6,
+        checksum == expected ? "" : "  MISMATCH") << std::endl;
+}
+
+} // namespace
+
+int main() {
+    std::mt19937_64 rng(1);
+    std::cout << std::format("{:<8}{:<14}{:>10}", "assoc", "lookup", "speed") << std::endl;
+    for (int associativity : {2, 4, 8, 16, 32, 64}) {
+        size_t set_count = kWays / associativity;
+        int words = (associativity + 63) / 64;
+
+        std::vector<CacheBlock> blocks(kWays);
+        std::vector<uint64_t> tags(kWays);
+        std::vector<uint64_t> valid(set_count * words, 0);
+        for (size_t i = 0; i < kWays; i++) {
+            // a few invalid blocks, so the valid bitmap matters
+            bool is_valid = rng() % 16 != 0;
+            uint64_t tag = rng() % (4 * associativity);
+            blocks[i] = CacheBlock{tag, is_valid, false, 0};
+            tags[i] = tag;
+            size_t set = i / associativity;
+            size_t way = i % associativity;
+            valid[set * words + way / 64] |= uint64_t(is_valid) << (way % 64);
+        }
+        std::vector<std::pair<uint32_t, uint64_t>> lookups(kLookups);
+        for (auto &lookup : lookups) {
+            lookup = {uint32_t(rng() % set_count), rng() % (4 * associativity)};
+        }
+
+        auto flat = [&](FindTagFunction find) {
+            return [&, find]() {
+                uint64_t checksum = 0;
+                for (auto [set, tag] : lookups) {
+                    checksum += find(tags.data() + size_t(set) * associativity, valid.data() + size_t(set) * words,
+                        associativity, tag) + 1;
+                }
+                return checksum;
+            };
+        };
+        auto blocks_lookup = [&]() {
+            uint64_t checksum = 0;
+            for (auto [set, tag] : lookups) {
+                checksum += block_hit_index(blocks.data() + size_t(set) * associativity, associativity, tag) + 1;
+            }
+            return checksum;
+        };
+
+        uint64_t expected = blocks_lookup();
+        run("CacheBlock", associativity, blocks_lookup, expected);
+        run("flat scalar", associativity, flat(find_tag_scalar), expected);
+        if (__builtin_cpu_supports("sse4.1")) {
+            run("flat sse4.1", associativity, flat(find_tag_sse4), expected);
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            run("flat avx2", associativity, flat(find_tag_avx2), expected);
+        }
+    }
+    return 0;
+}
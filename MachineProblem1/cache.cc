@@ -1,8 +1,24 @@
 #include "cache.h"
+#include "checkpoint.h"
 #include <iostream>
 #include <format>
 #include <string>
 #include <cmath>
+#include <bit>
+#include <algorithm>
+
+namespace {
+
+// a hit in the victim cache or write buffer
+const int kBufferLatency = 1;
+
+// text padded to the label column, a label too long for it still gets a space
+std::string label(std::string text, int width) {
+    text.resize(std::max<size_t>(width, text.size() + 1), ' ');
+    return text;
+}
+
+} // namespace
 
 Cache::Cache(int size, int block_size, int associativity, ReplacementPolicy replacement, InclusionPolicy inclusion)
     :
@@ -10,6 +26,11 @@ Cache::Cache(int size, int block_size, int associativity, ReplacementPolicy repl
     set_count_((block_size * associativity) == 0 ? 0 : size / (block_size * associativity)), 
     replacement_(replacement), inclusion_(inclusion) {
 
+    // block_size_ bits is log2(block_size_). for log2(32) = 5
+    // set_count_ bits is log2(set_count_). for log2(8) = 3
+    offset_bits_ = block_size_ > 0 ? std::bit_width(unsigned(block_size_)) - 1 : 0;
+    index_bits_ = set_count_ > 0 ? std::bit_width(unsigned(set_count_)) - 1 : 0;
+
     if (block_size % 2 != 0) {
         std::cerr << "block_size must be a power of 2" << std::endl;
         exit(1);
@@ -20,180 +41,618 @@ Cache::Cache(int size, int block_size, int associativity, ReplacementPolicy repl
         exit(1);
     }
 
-    sets_ = std::vector<Set>(set_count_, Set(associativity_, replacement_, inclusion_));
+    // the tree of PLRU is a complete binary tree over the ways
+    if (replacement_ == PLRU && associativity_ > 0 && !std::has_single_bit(unsigned(associativity_))) {
+        std::cerr << std::format("PLRU associativity({}) must be power of 2", associativity_) << std::endl;
+        exit(1);
+    }
+
+    rng_.seed(0);
+
+    size_t ways = size_t(set_count_) * associativity_;
+    words_per_set_ = (associativity_ + 63) / 64;
+    tags_ = std::vector<uint64_t>(ways, 0);
+    addresses_ = std::vector<uint64_t>(ways, 0);
+    valid_bits_ = std::vector<uint64_t>(size_t(set_count_) * words_per_set_, 0);
+    dirty_bits_ = std::vector<uint64_t>(size_t(set_count_) * words_per_set_, 0);
+    shared_bits_ = std::vector<uint64_t>(size_t(set_count_) * words_per_set_, 0);
+    if (replacement_ == LRU) {
+        lru_stamps_ = std::vector<uint64_t>(ways, 0);
+    }
+    if (replacement_ == OPTIMAL) {
+        next_uses_ = std::vector<uint32_t>(ways, 0);
+        opt_heap_ = std::vector<int>(ways);
+        opt_slot_ = std::vector<int>(ways);
+        // every key is 0, so any order is a heap
+        for (size_t i = 0; i < ways; i++) {
+            opt_heap_[i] = opt_slot_[i] = i % associativity_;
+        }
+    }
+    if (is_rrip(replacement_)) {
+        rrip_low_ = std::vector<uint64_t>(size_t(set_count_) * words_per_set_, 0);
+        rrip_high_ = std::vector<uint64_t>(size_t(set_count_) * words_per_set_, 0);
+    }
+    if (replacement_ == PLRU) {
+        plru_bits_ = std::vector<uint64_t>(size_t(set_count_) * words_per_set_, 0);
+    }
+    all_ways_ = std::vector<uint64_t>(words_per_set_, ~uint64_t(0));
+    if (associativity_ % 64 != 0) {
+        all_ways_.back() = (uint64_t(1) << (associativity_ % 64)) - 1;
+    }
+
+    set_states_ = std::vector<SetState>(set_count_);
+    set_arrays_ = SetArrays{associativity_, words_per_set_, replacement_, tags_.data(), addresses_.data(),
+        valid_bits_.data(), dirty_bits_.data(), shared_bits_.data(), set_states_.data(),
+        lru_stamps_.empty() ? nullptr : lru_stamps_.data(), &rng_, next_uses_.empty() ? nullptr : next_uses_.data(),
+        opt_heap_.empty() ? nullptr : opt_heap_.data(), opt_slot_.empty() ? nullptr : opt_slot_.data(), all_ways_.data()};
+    if (is_rrip(replacement_)) {
+        set_arrays_.rrip_low = rrip_low_.data();
+        set_arrays_.rrip_high = rrip_high_.data();
+    }
+    if (replacement_ == DRRIP) {
+        // 32 leader sets of each policy spread over the index range, at most a quarter of the sets
+        // each so at least half follow PSEL. A cache of fewer than 4 sets has no leaders, it is SRRIP
+        int leaders = std::min(32, set_count_ / 4);
+        set_arrays_.psel = &psel_;
+        set_arrays_.leader_spacing = leaders == 0 ? 0 : set_count_ / leaders;
+    }
+    if (replacement_ == PLRU) {
+        set_arrays_.plru_bits = plru_bits_.data();
+    }
+}
+
+void Cache::set_seed(uint64_t seed) {
+    rng_.seed(seed);
+}
+
+void Cache::set_next_use(const NextUse *next_use) {
+    if (next_use->block_size() != block_size_) {
+        std::cerr << "next use block size must match the cache" << std::endl;
+        exit(1);
+    }
+    // a restored cache is already part way through the trace
+    next_use_ = next_use;
+}
+
+void Cache::set_prefetcher(const PrefetchConfig &config) {
+    if (replacement_ == OPTIMAL) {
+        std::cerr << "OPTIMAL replacement can't prefetch!" << std::endl;
+        exit(1);
+    }
+    prefetcher_ = make_prefetcher(config, offset_bits_);
+    prefetch_stats_.latency = config.latency;
+    prefetched_bits_ = std::vector<uint64_t>(size_t(set_count_) * words_per_set_, 0);
+    prefetch_times_ = std::vector<uint64_t>(size_t(set_count_) * associativity_, 0);
+    set_arrays_.prefetched = prefetched_bits_.data();
+    set_arrays_.prefetch_times = prefetch_times_.data();
+    set_arrays_.prefetch_stats = &prefetch_stats_;
+}
+
+void Cache::set_victim_cache(int entries) {
+    victim_cache_ = std::make_unique<VictimCache>(entries, offset_bits_);
+}
+
+void Cache::set_write_buffer(int entries) {
+    write_buffer_ = std::make_unique<WriteBuffer>(entries, offset_bits_);
+}
+
+void Cache::set_latency(int hit_latency, int memory_latency) {
+    hit_latency_ = hit_latency;
+    memory_latency_ = memory_latency;
+}
+
+void Cache::classify_misses() {
+    miss_classifier_ = std::make_unique<MissClassifier>(set_count_ * associativity_);
+}
+
+void Cache::drain_write_buffer() {
+    CacheBlock drained;
+    while (write_buffer_ != nullptr && write_buffer_->drain(drained)) {
+        if (child_ != nullptr) {
+            child_->access(drained.address, WRITE, drained.next_use, false);
+        }
+    }
+}
+
+void Cache::write_back(const CacheBlock &block) {
+    CacheBlock drained;
+    if (write_buffer_ == nullptr) {
+        drained = block;
+    } else if (!write_buffer_->write(block, drained)) {
+        return;
+    }
+    if (child_ != nullptr) {
+        child_->access(drained.address, WRITE, drained.next_use, false);
+    }
+}
+
+void Cache::save(CheckpointWriter &out) const {
+    out.put(size_);
+    out.put(block_size_);
+    out.put(associativity_);
+    out.put(replacement_);
+    out.put(inclusion_);
+    out.put(tags_);
+    out.put(addresses_);
+    out.put(valid_bits_);
+    out.put(dirty_bits_);
+    out.put(shared_bits_);
+    out.put(lru_stamps_);
+    out.put(rrip_low_);
+    out.put(rrip_high_);
+    out.put(psel_);
+    out.put(plru_bits_);
+    out.put(next_uses_);
+    out.put(opt_heap_);
+    out.put(opt_slot_);
+    out.put(rng_.state);
+    out.put<uint64_t>(record_);
+    for (int i = 0; i < set_count_; i++) {
+        Set(set_arrays_, i).save(out);
+    }
+    out.put(count_);
+    out.put(get_stats());
+}
+
+bool Cache::load(CheckpointReader &in) {
+    if (!(in.expect(size_) && in.expect(block_size_) && in.expect(associativity_) && in.expect(replacement_) &&
+        in.expect(inclusion_))) {
+        return false;
+    }
+    uint64_t record;
+    CacheStats stats;
+    bool ok = in.get(tags_) && in.get(addresses_) && in.get(valid_bits_) && in.get(dirty_bits_) && in.get(shared_bits_) &&
+        in.get(lru_stamps_) && in.get(rrip_low_) && in.get(rrip_high_) && in.get(psel_) && in.get(plru_bits_) &&
+        in.get(next_uses_) && in.get(opt_heap_) && in.get(opt_slot_) && in.get(rng_.state) &&
+        in.get(record);
+    for (int i = 0; i < set_count_ && ok; i++) {
+        ok = Set(set_arrays_, i).load(in);
+    }
+    if (!(ok && in.get(count_) && in.get(stats))) {
+        return false;
+    }
+    record_ = record;
+    reads_ = stats.reads;
+    read_misses_ = stats.read_misses;
+    writes_ = stats.writes;
+    write_misses_ = stats.write_misses;
+    writebacks_ = stats.writebacks;
+    writeback_to_memory_ = stats.writeback_to_memory;
+    return true;
+}
+
+uint32_t Cache::record_next_use() {
+    if (replacement_ != OPTIMAL) {
+        return 0;
+    }
+    if (next_use_ == nullptr || record_ >= next_use_->size()) {
+        std::cerr << "OPT replacement needs the whole trace in advance!" << std::endl;
+        exit(1);
+    }
+    return (*next_use_)[record_++];
+}
+
+Set Cache::set_of(uint64_t address, CacheBlock &block) {
+    int index = (address >> offset_bits_) & ((uint64_t(1) << index_bits_) - 1);
+    block = CacheBlock{address >> (offset_bits_ + index_bits_), true, false, address};
+    return Set(set_arrays_, index % set_count_);
+}
+
+MesiState Cache::mesi_state(uint64_t address) {
+    CacheBlock block;
+    return set_of(address, block).state(block);
+}
+
+MesiState Cache::snoop(uint64_t address, Mode mode) {
+    CacheBlock block;
+    return set_of(address, block).snoop(block, mode);
+}
+
+void Cache::set_shared(uint64_t address, bool shared) {
+    CacheBlock block;
+    set_of(address, block).set_shared(block, shared);
+}
+
+void Cache::refresh_next_use(uint64_t address, uint32_t next_use) {
+    CacheBlock block;
+    Set set = set_of(address, block);
+    block.next_use = next_use;
+    set.refresh_next_use(block);
+    if (child_ != nullptr) {
+        child_->refresh_next_use(address, next_use);
+    }
 }
 
 void Cache::set_child(std::shared_ptr<Cache> child) {
     child_ = child;
 }
-void Cache::set_parent(std::shared_ptr<Cache> parent) {
-    parent_ = parent;
+void Cache::add_parent(std::shared_ptr<Cache> parent) {
+    parents_.push_back(parent);
 }
 
 std::shared_ptr<Cache> Cache::get_child() {
     return child_;
 }
 
-std::shared_ptr<Cache> Cache::get_parent() {
-    return parent_;
+const std::vector<std::shared_ptr<Cache>> &Cache::get_parents() {
+    return parents_;
 }
 
-int Cache::get_writeback_to_memory() {
+uint64_t Cache::get_writeback_to_memory() {
     return writeback_to_memory_;
 }
 
-void Cache::read(const std::string &address_hex) {
-    access(address_hex, READ);
+CacheStats &CacheStats::operator+=(const CacheStats &other) {
+    reads += other.reads;
+    read_misses += other.read_misses;
+    writes += other.writes;
+    write_misses += other.write_misses;
+    writebacks += other.writebacks;
+    writeback_to_memory += other.writeback_to_memory;
+    return *this;
+}
+
+CacheStats Cache::get_stats() const {
+    return CacheStats{reads_, read_misses_, writes_, write_misses_, writebacks_, writeback_to_memory_};
 }
 
-void Cache::write(const std::string &address_hex) {
-    access(address_hex, WRITE);
+uint64_t Cache::get_memory_traffic() {
+    // every prefetch fetched a block
+    uint64_t traffic = read_misses_ + write_misses_ + writebacks_ + prefetch_stats_.issued;
+    // misses served by the victim cache or write buffer, and merged writebacks, don't reach memory
+    if (victim_cache_ != nullptr) {
+        traffic -= victim_cache_->get_hits();
+    }
+    if (write_buffer_ != nullptr) {
+        traffic -= write_buffer_->get_read_hits() + write_buffer_->get_merges();
+    }
+    // dirty blocks invalidated above by an inclusive level are written to memory directly
+    for (const auto &parent : parents_) {
+        traffic += parent->get_invalidation_traffic();
+    }
+    return traffic;
 }
 
-void Cache::invalidate(const std::string &address_hex) {
-    access(address_hex, INVALIDATE);
+uint64_t Cache::get_invalidation_traffic() {
+    uint64_t traffic = writeback_to_memory_;
+    for (const auto &parent : parents_) {
+        traffic += parent->get_invalidation_traffic();
+    }
+    return traffic;
 }
 
-void Cache::access(const std::string &address_hex, Mode mode) {
+void Cache::invalidate_parents(uint64_t address) {
+    for (const auto &parent : parents_) {
+        if (parent->block_size_ >= block_size_) {
+            parent->invalidate(address);
+            continue;
+        }
+        // a smaller block above: every one of them inside this block goes
+        uint64_t first = address >> offset_bits_ << offset_bits_;
+        for (uint64_t block = first; block < first + block_size_; block += parent->block_size_) {
+            parent->invalidate(block);
+        }
+    }
+}
+
+int Cache::read(uint64_t address) {
+    return access(address, READ, record_next_use(), true);
+}
+
+int Cache::write(uint64_t address) {
+    return access(address, WRITE, record_next_use(), true);
+}
+
+void Cache::invalidate(uint64_t address) {
+    access(address, INVALIDATE, 0, false);
+}
+
+int Cache::access(uint64_t address, Mode mode, uint32_t next_use, bool critical) {
     ++count_;
+    // a demand hit on a prefetched block counts as useful, which the prefetcher is told
+    prefetch_stats_.clock = count_;
+    uint64_t useful = prefetch_stats_.useful;
     if (mode == READ) {
         ++reads_;
     } else if (mode == WRITE) {
         ++writes_;
     }
-    // address is 32 bits, 8 hex digits, 4 bits per hex digit
-    // block_size_ bits is log2(block_size_). for log2(32) = 5
-    // set_count_ bits is log2(set_count_). for log2(8) = 3
-    // tag + index + block_offset = 32
-    int address_bits = address_hex.size() * 4;
-    int offset_bits = log2(block_size_);
-    int index_bits = log2(set_count_);
-    int tag_bits = address_bits - offset_bits - index_bits;
-
-    int address = std::stoi(address_hex, nullptr, 16);
-
-    // for debug output
-    int effective_address = address >> offset_bits << offset_bits;
-    current_effective_address_ = std::format("{:x}", effective_address);
-
+    // tag + index + block_offset = address bits
     // for simulator, don't care about block offset
-    int index = (address >> offset_bits) & ((1 << index_bits) - 1);
-    int tag = (address >> (offset_bits + index_bits)) & ((1 << tag_bits) - 1);
-    std::string tag_hex = std::format("{:x}", tag);
+    int index = (address >> offset_bits_) & ((uint64_t(1) << index_bits_) - 1);
+    uint64_t tag = address >> (offset_bits_ + index_bits_);
     index = index % set_count_;
 
     // valid and not dirty
-    CacheBlock block{tag_hex, true, false, address_hex};
+    CacheBlock block{tag, true, false, address, next_use};
 
     // for debug
     current_block_ = block;
     current_mode_ = mode;
-    current_victim_ = "";
     current_set_dirty_ = false;
     current_missed_ = false;
     current_set_index_ = index;
-    current_victim_dirty_ = false;
+    current_victim_ = CacheBlock();
 
-    std::string victim_address;
+    CacheBlock victim;
     bool hitted;
-    if (replacement_ == LRU) {
-        hitted = sets_[index].lru_access(block, victim_address, mode, current_set_dirty_, current_victim_dirty_, writeback_to_memory_);
-    } else if (replacement_ == FIFO) {
-        hitted = sets_[index].fifo_access(block, victim_address, mode, current_set_dirty_, current_victim_dirty_, writeback_to_memory_);
+    if (replacement_ == FIFO) {
+        hitted = Set(set_arrays_, index).fifo_access(block, victim, mode, current_set_dirty_, writeback_to_memory_);
     } else {
-        exit(-1);
+        hitted = Set(set_arrays_, index).access(block, victim, mode, current_set_dirty_, writeback_to_memory_);
     }
     
+    if (miss_classifier_ != nullptr && mode != INVALIDATE) {
+        miss_classifier_->access(address >> offset_bits_, !hitted);
+    }
+
+    if (hitted && replacement_ == OPTIMAL && mode != INVALIDATE && child_ != nullptr) {
+        child_->refresh_next_use(address, next_use);
+    }
+
+    // an inclusive level below evicted the block, so every level above this one loses it too
+    if (mode == INVALIDATE) {
+        bool dirty = false;
+        if (victim_cache_ != nullptr && victim_cache_->invalidate(address, dirty) && dirty) {
+            ++writeback_to_memory_;
+        }
+        invalidate_parents(address);
+        return 0;
+    }
+
+    int cycles = hit_latency_;
+    if (critical) {
+        timing_.cycles += hit_latency_;
+    }
     if (!hitted) {
         current_missed_ = true;
+        current_victim_ = victim;
         if (mode == READ) {
             ++read_misses_;
         } else if (mode == WRITE) {
             ++write_misses_;
         }
-        // CACHE issues a write request (only if there is a victim block and it is dirty)
-        if (victim_address != "") {
-            current_victim_ = victim_address;
-            int victim_int = std::stoi(victim_address, nullptr, 16);
-            int victim_tag = victim_int >> (offset_bits + index_bits);
-            current_victim_tag_ = std::format("{:x}", victim_tag);
-            current_victim_index_ = (victim_int >> offset_bits) & ((1 << index_bits) - 1);
-            int victim_effective_address = victim_int >> offset_bits << offset_bits;
-            current_victim_effective_address_ = std::format("{:x}", victim_effective_address);
-            if (current_victim_dirty_ == true) {
+        cycles += fetch(address, index, block, victim, next_use, critical);
+    }
+
+    if (prefetcher_ != nullptr) {
+        prefetch_requests_.clear();
+        prefetcher_->access(address >> offset_bits_, !hitted, prefetch_stats_.useful != useful, prefetch_requests_);
+        for (uint64_t prefetch_block : prefetch_requests_) {
+            prefetch(prefetch_block << offset_bits_);
+        }
+    }
+    return cycles;
+}
+
+int Cache::fetch(uint64_t address, int index, const CacheBlock &block, const CacheBlock &victim, uint32_t next_use,
+    bool critical) {
+    if (child_ != nullptr && child_->inclusion_ == EXCLUSIVE) {
+        // the block comes from the level below if it's there, which frees room for the victim
+        bool dirty = false;
+        int cycles = 0;
+        if (child_->promote(address, next_use, critical, dirty, cycles) && dirty) {
+            Set(set_arrays_, index).mark_dirty(block);
+        }
+        if (victim.valid) {
+            if (victim.dirty) {
                 ++writebacks_;
             }
+            child_->insert_victim(victim);
+        }
+        return cycles;
+    }
 
-            if (inclusion_ == INCLUSIVE && parent_ != nullptr) { // L2 misses, invalidate L1
-                parent_->invalidate(victim_address);
-            }
-            
-            if (current_victim_dirty_ && child_ != nullptr) {
-                child_->write(victim_address);
-            }
+    // a victim cache hit brings the block back without asking the level below, and the victim
+    // takes its place. What leaves the victim cache leaves this level
+    bool victim_hit = false;
+    CacheBlock evicted = victim;
+    if (victim_cache_ != nullptr) {
+        CacheBlock returning;
+        victim_hit = victim_cache_->take(address, returning);
+        if (victim_hit && returning.dirty) {
+            Set(set_arrays_, index).mark_dirty(block);
         }
-        // followed by a read request
-        if (child_ != nullptr) {
-            child_->read(address_hex);
+        if (victim.valid && !victim_cache_->insert(victim, evicted)) {
+            evicted = CacheBlock();
         }
     }
 
+    // CACHE issues a write request (only if there is a victim block and it is dirty)
+    if (evicted.valid) {
+        if (evicted.dirty) {
+            ++writebacks_;
+        }
+
+        if (inclusion_ == INCLUSIVE) { // L2 misses, invalidate L1
+            invalidate_parents(evicted.address);
+        }
+        
+        if (evicted.dirty) {
+            write_back(evicted);
+        }
+    }
+    // followed by a read request, unless the victim cache or write buffer has the block
+    if (victim_hit || (write_buffer_ != nullptr && write_buffer_->read(address))) {
+        if (critical) {
+            timing_.cycles += kBufferLatency;
+        }
+        return kBufferLatency;
+    }
+    if (child_ != nullptr) {
+        return child_->access(address, READ, next_use, critical);
+    }
+    if (critical) {
+        timing_.memory_cycles += memory_latency_;
+    }
+    return memory_latency_;
+}
+
+void Cache::prefetch(uint64_t address) {
+    CacheBlock block;
+    Set set = set_of(address, block);
+    CacheBlock victim;
+    if (set.prefetch(block, victim)) {
+        fetch(address, set.get_index(), block, victim, 0, false);
+    }
+}
+
+bool Cache::promote(uint64_t address, uint32_t next_use, bool critical, bool &dirty, int &cycles) {
+    ++reads_;
+    cycles = hit_latency_;
+    if (critical) {
+        timing_.cycles += hit_latency_;
+    }
+    CacheBlock block;
+    bool hitted = set_of(address, block).remove(block, dirty);
+    if (miss_classifier_ != nullptr) {
+        miss_classifier_->access(address >> offset_bits_, !hitted);
+    }
+    if (hitted) {
+        return true;
+    }
+    ++read_misses_;
+    if (child_ != nullptr && child_->inclusion_ == EXCLUSIVE) {
+        int below = 0;
+        bool promoted = child_->promote(address, next_use, critical, dirty, below);
+        cycles += below;
+        return promoted;
+    }
+    // a level below the exclusive ones fills as usual
+    if (child_ != nullptr) {
+        cycles += child_->access(address, READ, next_use, critical);
+    } else {
+        cycles += memory_latency_;
+        if (critical) {
+            timing_.memory_cycles += memory_latency_;
+        }
+    }
+    return false;
+}
+
+void Cache::insert_victim(const CacheBlock &block) {
+    // a victim always misses here, and needs nothing from memory since the whole block arrives
+    ++writes_;
+    CacheBlock placed;
+    Set set = set_of(block.address, placed);
+    placed.dirty = block.dirty;
+    placed.next_use = block.next_use;
+    CacheBlock victim;
+    if (!set.insert(placed, victim)) {
+        return;
+    }
+    if (victim.dirty) {
+        ++writebacks_;
+    }
+    if (child_ != nullptr && child_->inclusion_ == EXCLUSIVE) {
+        child_->insert_victim(victim);
+    } else if (child_ != nullptr && victim.dirty) {
+        child_->access(victim.address, WRITE, victim.next_use, false);
+    }
 }
 
 void Cache::print_cache(const std::string &cache_name) {
     std::cout << "===== " << cache_name << " =====" << std::endl;
+    print_sets(0, 0);
+}
+
+void Cache::print_sets(int first_set, int tag_shift) {
     for (int i = 0; i < set_count_; i++) {
-        std::cout <<  std::format("{:<8}", "Set") << std::format("{:<8}", std::to_string(i) + ":");
+        std::cout <<  std::format("{:<8}", "Set") << std::format("{:<8}", std::to_string(first_set + i) + ":");
         for (int j = 0; j < associativity_; j++) {
-            std::string tag = sets_[i][j].tag;
+            // a block that was never filled has no tag to print, an invalidated one keeps its tag
+            CacheBlock block = Set(set_arrays_, i)[j];
+            std::string tag = (block.valid || block.address != 0) ? std::format("{:x}", block.tag >> tag_shift) : "";
             // append "D" if dirty
-            tag += ((sets_[i][j].dirty) ? " D" : "");
+            tag += ((block.dirty) ? " D" : "");
             std::cout << std::format("{:<10}", tag); //
         }
         std::cout << std::endl;
     }
 }
 
-void Cache::print_summary(const std::string &cache_name, char start_char) {
+int Cache::label_width(size_t longest_name) {
+    return kLabelWidth + std::max(0, int(longest_name) - 2);
+}
+
+void Cache::print_summary(const std::string &cache_name, char start_char, int width) {
+    print_summary(get_stats(), cache_name, start_char, parents_.empty(), width);
+}
+
+void Cache::print_traffic(char start_char) {
+    print_traffic(get_memory_traffic(), start_char);
+}
 
-    std::cout << start_char << ". " << std::format("{:<27}", "number of " + cache_name + " reads:") << reads_ << std::endl;
-    std::cout << char(start_char + 1) << ". " << std::format("{:<27}", "number of " + cache_name + " read misses:") << read_misses_ << std::endl;
-    std::cout << char(start_char + 2) << ". " << std::format("{:<27}", "number of " + cache_name + " writes:") << writes_ << std::endl;
-    std::cout << char(start_char + 3) << ". " << std::format("{:<27}", "number of " + cache_name + " write misses:") << write_misses_ << std::endl;
+void Cache::print_summary(const CacheStats &stats, const std::string &cache_name, char start_char, bool first_level,
+    int width) {
+    std::cout << start_char << ". " << label("number of " + cache_name + " reads:", width) << stats.reads << std::endl;
+    std::cout << char(start_char + 1) << ". " << label("number of " + cache_name + " read misses:", width) << stats.read_misses << std::endl;
+    std::cout << char(start_char + 2) << ". " << label("number of " + cache_name + " writes:", width) << stats.writes << std::endl;
+    std::cout << char(start_char + 3) << ". " << label("number of " + cache_name + " write misses:", width) << stats.write_misses << std::endl;
     double miss_rate;
-    if (reads_ + writes_ == 0) {
+    if (stats.reads + stats.writes == 0) {
         miss_rate = 0;
-        std::cout << char(start_char + 4) << ". " << std::format("{:<27}", cache_name + " miss rate:") << std::format("{:.0f}", miss_rate) << std::endl;
+        std::cout << char(start_char + 4) << ". " << label(cache_name + " miss rate:", width) << std::format("{:.0f}", miss_rate) << std::endl;
     } else {
-        if ((cache_name == "L1")) {
-           miss_rate = (read_misses_ + write_misses_) / (double)(reads_ + writes_); 
-        } else if (cache_name == "L2")
-        {
-            miss_rate = read_misses_ / (double)reads_;
+        if (first_level) {
+           miss_rate = (stats.read_misses + stats.write_misses) / (double)(stats.reads + stats.writes);
+        } else {
+            // the writes of a lower level are writebacks from above, only its read misses stall the CPU
+            miss_rate = stats.reads == 0 ? 0 : stats.read_misses / (double)stats.reads;
         }
-        std::cout << char(start_char + 4) << ". " << std::format("{:<27}", cache_name + " miss rate:") << std::format("{:.6f}", miss_rate) << std::endl;
+        std::cout << char(start_char + 4) << ". " << label(cache_name + " miss rate:", width) << std::format("{:.6f}", miss_rate) << std::endl;
     }
     
-    std::cout << char(start_char + 5) << ". " << std::format("{:<27}", "number of " + cache_name + " writebacks:") << writebacks_ << std::endl;
-}
-
-void Cache::print_traffic(const std::string &cache_name, char start_char) {
-    if (cache_name == "L1") {
-        std::cout << start_char << ". " << std::format("{:<27}", "total memory traffic: ") << read_misses_ + write_misses_ + writebacks_ << std::endl;
-    } else if (cache_name == "L2") {
-        int traffic;
-        if (inclusion_ == NON_INCLUSIVE) {
-            traffic = read_misses_ + write_misses_ + writebacks_;
-        } else if (inclusion_ == INCLUSIVE) {
-            traffic = read_misses_ + write_misses_ + writebacks_ + parent_->get_writeback_to_memory();
-        } else {
-            exit(-1);
-        }
-        
-        std::cout << start_char << ". " << std::format("{:<27}", "total memory traffic: ") << traffic << std::endl;
+    std::cout << char(start_char + 5) << ". " << label("number of " + cache_name + " writebacks:", width) << stats.writebacks << std::endl;
+}
+
+void Cache::print_traffic(uint64_t traffic, char start_char, int width) {
+    std::cout << start_char << ". " << label("total memory traffic: ", width) << traffic << std::endl;
+}
+
+
+void Cache::print_prefetch_summary(const std::string &cache_name, char start_char, int width) {
+    const PrefetchStats &stats = prefetch_stats_;
+    std::cout << start_char << ". " << label("number of " + cache_name + " prefetches:", width) << stats.issued << std::endl;
+    std::cout << char(start_char + 1) << ". " << label(cache_name + " useful prefetches:", width) << stats.useful << std::endl;
+    std::cout << char(start_char + 2) << ". " << label(cache_name + " late prefetches:", width) << stats.late << std::endl;
+    std::cout << char(start_char + 3) << ". " << label(cache_name + " useless prefetches:", width) << stats.useless << std::endl;
+    std::cout << char(start_char + 4) << ". " << label(cache_name + " prefetch accuracy:", width)
+        << std::format("{:.6f}", stats.issued == 0 ? 0 : stats.useful / (double)stats.issued) << std::endl;
+    // a prefetch reads its block from the level below, or from memory
+    std::cout << char(start_char + 5) << ". " << label(cache_name + " prefetch traffic:", width) << stats.issued << std::endl;
+}
+
+char Cache::print_buffer_summary(const std::string &cache_name, char start_char, int width) {
+    if (victim_cache_ != nullptr) {
+        uint64_t lookups = victim_cache_->get_lookups();
+        std::cout << start_char++ << ". " << label("number of " + cache_name + " VC lookups:", width) << lookups << std::endl;
+        std::cout << start_char++ << ". " << label("number of " + cache_name + " VC hits:", width) << victim_cache_->get_hits() << std::endl;
+        std::cout << start_char++ << ". " << label(cache_name + " VC hit rate:", width)
+            << std::format("{:.6f}", lookups == 0 ? 0 : victim_cache_->get_hits() / (double)lookups) << std::endl;
+    }
+    if (write_buffer_ != nullptr) {
+        std::cout << start_char++ << ". " << label("number of " + cache_name + " WB writes:", width) << write_buffer_->get_writes() << std::endl;
+        std::cout << start_char++ << ". " << label("number of " + cache_name + " WB merges:", width) << write_buffer_->get_merges() << std::endl;
+        std::cout << start_char++ << ". " << label("number of " + cache_name + " WB read hits:", width) << write_buffer_->get_read_hits() << std::endl;
+        std::cout << start_char++ << ". " << label("number of " + cache_name + " WB drains:", width) << write_buffer_->get_drains() << std::endl;
     }
+    return start_char;
 }
 
+char Cache::print_timing_summary(const std::string &cache_name, char start_char, int width) {
+    std::cout << start_char++ << ". " << label(cache_name + " hit latency:", width) << hit_latency_ << std::endl;
+    std::cout << start_char++ << ". " << label(cache_name + " cycles:", width) << timing_.cycles << std::endl;
+    return start_char;
+}
+
+char Cache::print_miss_classification(const std::string &cache_name, char start_char, int width) {
+    const MissClassifier &classifier = *miss_classifier_;
+    std::cout << start_char++ << ". " << label(cache_name + " compulsory misses:", width) << classifier.get_compulsory() << std::endl;
+    std::cout << start_char++ << ". " << label(cache_name + " capacity misses:", width) << classifier.get_capacity() << std::endl;
+    std::cout << start_char++ << ". " << label(cache_name + " conflict misses:", width) << classifier.get_conflict() << std::endl;
+    return start_char;
+}
 
 void Cache::print_debug(const std::string &cache_name) {
     std::string mode;
@@ -202,18 +661,21 @@ void Cache::print_debug(const std::string &cache_name) {
     } else if (current_mode_ == WRITE) {
         mode = "write";
     }
-    std::string tmp1 =  std::to_string(count_) + " : " + mode + " " + current_block_.address_hex;
+    uint64_t effective_address = current_block_.address >> offset_bits_ << offset_bits_;
+    std::string tmp1 =  std::to_string(count_) + " : " + mode + " " + std::format("{:x}", current_block_.address);
     std::cout << "# " << tmp1 << std::endl;
-    tmp1 = cache_name + " " + mode + " : " + current_effective_address_ + 
-        " (tag " + current_block_.tag + ", index " + std::to_string(current_set_index_) + ")";
+    tmp1 = cache_name + " " + mode + " : " + std::format("{:x}", effective_address) + 
+        " (tag " + std::format("{:x}", current_block_.tag) + ", index " + std::to_string(current_set_index_) + ")";
     std::cout << tmp1 << std::endl;
     if (current_missed_) {
         std::cout << cache_name << " miss" << std::endl;
         std::string victim = cache_name + " victim: ";
-        if (current_victim_ != "") {
-            victim += current_victim_effective_address_ + " (tag " + current_victim_tag_ + ", index " + std::to_string(current_victim_index_);
+        if (current_victim_.valid) {
+            uint64_t victim_effective_address = current_victim_.address >> offset_bits_ << offset_bits_;
+            int victim_index = (current_victim_.address >> offset_bits_) & ((uint64_t(1) << index_bits_) - 1);
+            victim += std::format("{:x}", victim_effective_address) + " (tag " + std::format("{:x}", current_victim_.tag) + ", index " + std::to_string(victim_index);
 
-            if (current_victim_dirty_) {
+            if (current_victim_.dirty) {
                 victim += ", dirty)";
             } else {
                 victim += ", clean)";
@@ -4,7 +4,35 @@
 #include <vector>
 #include <deque>
 #include <memory>
+#include <string>
+#include <cstdint>
 #include "set.h"
+#include "next_use.h"
+#include "prefetch.h"
+#include "victim_cache.h"
+#include "write_buffer.h"
+#include "miss_classifier.h"
+
+// the counters reported by print_summary
+struct CacheStats {
+    uint64_t reads = 0;
+    uint64_t read_misses = 0;
+    uint64_t writes = 0;
+    uint64_t write_misses = 0;
+    uint64_t writebacks = 0;
+    uint64_t writeback_to_memory = 0;
+
+    // merge the counters of caches that each simulated part of the sets
+    CacheStats &operator+=(const CacheStats &other);
+};
+
+// cycles CPU accesses spent in a level, see Cache::set_latency
+struct TimingStats {
+    // lookups of this level, and of its victim cache and write buffer
+    uint64_t cycles = 0;
+    // fetches of this level from memory
+    uint64_t memory_cycles = 0;
+};
 
 class Cache {
 
@@ -13,24 +41,127 @@ public:
         InclusionPolicy inclusion = NON_INCLUSIVE);
     ~Cache() = default;
 
+    // set_arrays_ holds raw pointers into the member vectors, a copy would share them
+    Cache(const Cache &) = delete;
+    Cache &operator=(const Cache &) = delete;
+
+    // seed of the RANDOM replacement generator, the same seed gives the same run
+    void set_seed(uint64_t seed);
+    // OPTIMAL: the future of the trace driven through read / write, set on L1 only.
+    // Lower levels get the next use of each request from the level above
+    void set_next_use(const NextUse *next_use);
+
+    // the blocks, replacement state, position in the OPT future and counters of this level only.
+    // load fails if the checkpoint was saved from another configuration
+    void save(CheckpointWriter &out) const;
+    bool load(CheckpointReader &in);
+
+    // attach a prefetcher, before the first access. The blocks it picks are filled like misses,
+    // from the level below, after each demand access. Not for OPTIMAL, it has no future for them,
+    // nor for an exclusive level below another
+    void set_prefetcher(const PrefetchConfig &config);
+    bool has_prefetcher() const { return prefetcher_ != nullptr; }
+    const PrefetchStats &get_prefetch_stats() const { return prefetch_stats_; }
+
+    // a victim cache of entries blocks, looked up on a miss before the level below, and a write buffer
+    // of entries writebacks in front of the level below. Not above an exclusive level
+    void set_victim_cache(int entries);
+    void set_write_buffer(int entries);
+    bool has_victim_cache() const { return victim_cache_ != nullptr; }
+    bool has_write_buffer() const { return write_buffer_ != nullptr; }
+    // at the end of a run, write what is left in the write buffer to the level below
+    void drain_write_buffer();
+
+    // the cycles of a lookup here, and of a fetch from memory when there's no level below. read and
+    // write return the cycles until the CPU has its data, the ones of the accesses on that path add
+    // up in get_timing_stats. Writebacks and prefetches are off the path
+    void set_latency(int hit_latency, int memory_latency);
+    int get_hit_latency() const { return hit_latency_; }
+    const TimingStats &get_timing_stats() const { return timing_; }
+
+    // sort the read and write misses from now on into compulsory, capacity and conflict ones
+    void classify_misses();
+    bool has_miss_classifier() const { return miss_classifier_ != nullptr; }
+
     void set_child(std::shared_ptr<Cache> child);
-    void set_parent(std::shared_ptr<Cache> parent);
+    // a level can sit below several caches, e.g. an L2 below split L1 instruction and data caches
+    void add_parent(std::shared_ptr<Cache> parent);
     std::shared_ptr<Cache> get_child();
-    std::shared_ptr<Cache> get_parent();
-
-    void read(const std::string &address_hex);
-    void write(const std::string &address_hex);
-    void invalidate(const std::string &address_hex);
-
-    int get_writeback_to_memory();
+    const std::vector<std::shared_ptr<Cache>> &get_parents();
+
+    int read(uint64_t address);
+    int write(uint64_t address);
+    void invalidate(uint64_t address);
+
+    uint64_t get_writeback_to_memory();
+    CacheStats get_stats() const;
+    // traffic between this cache and main memory, as reported by print_traffic
+    uint64_t get_memory_traffic();
+    int get_block_size() const { return block_size_; }
+    ReplacementPolicy get_replacement() const { return replacement_; }
+    InclusionPolicy get_inclusion() const { return inclusion_; }
+
+    // MESI, for a private cache of a multicore run (see multicore.h)
+    MesiState mesi_state(uint64_t address);
+    // a read (READ) or write (INVALIDATE) by another core, return the state before
+    MesiState snoop(uint64_t address, Mode mode);
+    void set_shared(uint64_t address, bool shared);
+    // the block the last read / write evicted, victim.valid is false if none
+    const CacheBlock &get_last_victim() const { return current_victim_; }
+    bool get_last_missed() const { return current_missed_; }
 
     void print_cache(const std::string &cache_name);
-    void print_summary(const std::string &cache_name, char start_char);
-    void print_traffic(const std::string &cache_name, char start_char);
+    // the rows of print_cache, numbered from first_set, with tags shifted right by tag_shift
+    void print_sets(int first_set, int tag_shift);
+    // the label column of the summaries below, 27 fits level names of 2 characters such as "L1" and "L2"
+    static constexpr int kLabelWidth = 27;
+    // the label column that keeps the values of every level aligned, given its longest name
+    static int label_width(size_t longest_name);
+    // the first level (no parents) reports its miss rate over all accesses, lower levels over reads
+    void print_summary(const std::string &cache_name, char start_char, int width = kLabelWidth);
+    void print_traffic(char start_char);
+    static void print_summary(const CacheStats &stats, const std::string &cache_name, char start_char, bool first_level,
+        int width = kLabelWidth);
+    static void print_traffic(uint64_t traffic, char start_char, int width = kLabelWidth);
+    // the PrefetchStats, and the blocks prefetches fetched from the level below
+    void print_prefetch_summary(const std::string &cache_name, char start_char, int width = kLabelWidth);
+    // the victim cache and write buffer counters, return the next start_char
+    char print_buffer_summary(const std::string &cache_name, char start_char, int width = kLabelWidth);
+    // hit latency and cycles of this level, return the next start_char
+    char print_timing_summary(const std::string &cache_name, char start_char, int width = kLabelWidth);
+    // the 3C counters, return the next start_char
+    char print_miss_classification(const std::string &cache_name, char start_char, int width = kLabelWidth);
     void print_debug(const std::string &cache_name);
 
 private:
-    void access(const std::string &address_hex, Mode mode);
+    // return the cycles of the access, critical if the CPU waits for it
+    int access(uint64_t address, Mode mode, uint32_t next_use, bool critical);
+    // the miss path: block went to set index in place of victim, bring it from the level below.
+    // Return the cycles that took
+    int fetch(uint64_t address, int index, const CacheBlock &block, const CacheBlock &victim, uint32_t next_use,
+        bool critical);
+    // fill the block at address for the prefetcher, unless it's here already
+    void prefetch(uint64_t address);
+    // send a dirty block to the level below, through the write buffer if there is one
+    void write_back(const CacheBlock &block);
+    // the set and block of address, for operations that look a block up without accessing it
+    Set set_of(uint64_t address, CacheBlock &block);
+    // OPTIMAL: next use of the trace record being read / written
+    uint32_t record_next_use();
+    // OPTIMAL: a hit above this level is a use this level doesn't see, keep its next use current
+    void refresh_next_use(uint64_t address, uint32_t next_use);
+
+    // dirty blocks of this level and the ones above written to memory by invalidations
+    uint64_t get_invalidation_traffic();
+    // invalidate the block at address in every level above, whatever their block size
+    void invalidate_parents(uint64_t address);
+
+    // EXCLUSIVE: a miss above asks this level for the block. On a hit the block moves up and leaves
+    // this level, dirty tells whether it moves up dirty. A miss asks the next level, or memory.
+    // cycles is the time that took. inclusion_ of a level is its relation to the levels above it
+    bool promote(uint64_t address, uint32_t next_use, bool critical, bool &dirty, int &cycles);
+    // EXCLUSIVE: take a block evicted from the level above, clean or dirty
+    void insert_victim(const CacheBlock &block);
 
 private:
     int size_;
@@ -38,11 +169,54 @@ private:
     int associativity_;
     int set_count_;
 
+    // computed once, used to split an address into tag / index / block offset
+    int offset_bits_;
+    int index_bits_;
+
     // data structure for FIFO
     // std::vector<Set> fifo_queue_;
 
-    // data structure for LRU
-    std::vector<Set> sets_;
+    // flat storage of all blocks, see SetArrays. set i owns elements [i * associativity_, (i + 1) * associativity_)
+    // of the arrays and words [i * words_per_set_, (i + 1) * words_per_set_) of the bitmaps
+    int words_per_set_;
+    std::vector<uint64_t> tags_;
+    std::vector<uint64_t> addresses_;
+    std::vector<uint64_t> valid_bits_;
+    std::vector<uint64_t> dirty_bits_;
+    std::vector<uint64_t> shared_bits_;
+    std::vector<uint64_t> lru_stamps_;
+    std::vector<uint64_t> rrip_low_;
+    std::vector<uint64_t> rrip_high_;
+    // DRRIP: starts out following SRRIP
+    int psel_ = 0;
+    std::vector<uint64_t> plru_bits_;
+    std::vector<uint64_t> all_ways_;
+    XorShift64 rng_;
+    std::vector<uint32_t> next_uses_;
+    std::vector<int> opt_heap_;
+    std::vector<int> opt_slot_;
+    std::vector<SetState> set_states_;
+    // every Set is a view of these, made from its index
+    SetArrays set_arrays_;
+
+    // with a prefetcher only: see SetArrays. Blocks picked after an access are collected in prefetch_requests_
+    std::unique_ptr<Prefetcher> prefetcher_;
+    std::vector<uint64_t> prefetched_bits_;
+    std::vector<uint64_t> prefetch_times_;
+    PrefetchStats prefetch_stats_;
+    std::vector<uint64_t> prefetch_requests_;
+
+    std::unique_ptr<VictimCache> victim_cache_;
+    std::unique_ptr<WriteBuffer> write_buffer_;
+
+    int hit_latency_ = 0;
+    int memory_latency_ = 0;
+    TimingStats timing_;
+
+    std::unique_ptr<MissClassifier> miss_classifier_;
+
+    const NextUse *next_use_ = nullptr;
+    size_t record_ = 0;
     
     // std::vector<std::vector<CacheBlock>> cache_;
     // std::vector<std::vector<bool>> lru_matrix_;
@@ -53,28 +227,23 @@ private:
 
     // child and parent
     std::shared_ptr<Cache> child_;
-    std::shared_ptr<Cache> parent_;
+    std::vector<std::shared_ptr<Cache>> parents_;
 
-    // for debug output
-    int count_ = 0;
+    // for debug output, strings are only built in print_debug
+    uint64_t count_ = 0;
     CacheBlock current_block_;
-    std::string current_effective_address_;
     int current_set_index_ = 0;
     Mode current_mode_;
-    std::string current_victim_;
+    CacheBlock current_victim_;
     bool current_set_dirty_ = false;
     bool current_missed_ = false;
-    bool current_victim_dirty_ = false;
-    std::string current_victim_tag_;
-    int current_victim_index_ = 0;
-    std::string current_victim_effective_address_;
-
-    int reads_ = 0;
-    int read_misses_ = 0;
-    int writes_ = 0;
-    int write_misses_ = 0;
-    int writebacks_ = 0;
-    int writeback_to_memory_ = 0; // due to invalidation
+
+    uint64_t reads_ = 0;
+    uint64_t read_misses_ = 0;
+    uint64_t writes_ = 0;
+    uint64_t write_misses_ = 0;
+    uint64_t writebacks_ = 0;
+    uint64_t writeback_to_memory_ = 0; // due to invalidation
 };
 
 
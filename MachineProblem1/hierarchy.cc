@@ -0,0 +1,391 @@
+#include "hierarchy.h"
+#include "cache.h"
+#include "next_use.h"
+#include "trace_reader.h"
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char *kMemory = "memory";
+
+const char *replacement_names[] = {"LRU", "FIFO", "RANDOM", "OPTIMAL", "SRRIP", "BRRIP", "DRRIP", "PLRU"};
+const char *inclusion_names[] = {"non-inclusive", "inclusive", "exclusive"};
+const char *role_names[] = {"unified", "instruction", "data"};
+
+// index of name in names, or -1
+template <size_t N>
+int find_name(const char *(&names)[N], const std::string &name) {
+    for (size_t i = 0; i < N; i++) {
+        if (name == names[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool parse_level(const std::string &line, LevelConfig &level) {
+    std::istringstream iss(line);
+    std::string replacement, inclusion, role = role_names[SERVES_UNIFIED], extra;
+    if (!(iss >> level.name >> level.size >> level.associativity >> level.block_size >> replacement >> inclusion
+        >> level.next)) {
+        return false;
+    }
+    // the role, then the options
+    bool has_option = false;
+    while (iss >> extra) {
+        size_t equals = extra.find('=');
+        if (equals == std::string::npos) {
+            if (has_option || role != role_names[SERVES_UNIFIED] || extra == role) {
+                return false;
+            }
+            role = extra;
+            continue;
+        }
+        has_option = true;
+        std::string key = extra.substr(0, equals);
+        std::string value = extra.substr(equals + 1);
+        if (key == "prefetch" && !level.prefetch) {
+            PrefetchConfig config;
+            if (!parse_prefetch_config(value, config)) {
+                return false;
+            }
+            level.prefetch = config;
+        } else if ((key == "victim" && level.victim_entries == 0) ||
+            (key == "write_buffer" && level.write_buffer_entries == 0) || (key == "latency" && level.latency == 0)) {
+            int entries = std::atoi(value.c_str());
+            if (entries < 1) {
+                return false;
+            }
+            (key == "victim" ? level.victim_entries : key == "latency" ? level.latency : level.write_buffer_entries) = entries;
+        } else {
+            return false;
+        }
+    }
+    int r = find_name(replacement_names, replacement);
+    int i = find_name(inclusion_names, inclusion);
+    int s = find_name(role_names, role);
+    if (r == -1 || i == -1 || s == -1) {
+        return false;
+    }
+    level.replacement = ReplacementPolicy(r);
+    level.inclusion = InclusionPolicy(i);
+    level.role = LevelRole(s);
+    return true;
+}
+
+int find_level(const std::vector<LevelConfig> &levels, const std::string &name) {
+    for (size_t i = 0; i < levels.size(); i++) {
+        if (levels[i].name == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool is_first_level(const std::vector<LevelConfig> &levels, const LevelConfig &level) {
+    return std::none_of(levels.begin(), levels.end(), [&](const LevelConfig &other) { return other.next == level.name; });
+}
+
+bool check_hierarchy(const std::vector<LevelConfig> &levels) {
+    if (levels.empty()) {
+        std::cerr << "Hierarchy has no levels!" << std::endl;
+        return false;
+    }
+    int instruction_levels = 0;
+    int data_levels = 0;
+    int first_levels = 0;
+    bool optimal = false;
+    for (const LevelConfig &level : levels) {
+        if (level.name == kMemory || find_level(levels, level.name) != &level - levels.data()) {
+            std::cerr << "Duplicate level name: " << level.name << std::endl;
+            return false;
+        }
+        if (level.block_size <= 0 || level.associativity <= 0 || level.size < level.block_size * level.associativity) {
+            std::cerr << "Level " << level.name << " has no sets!" << std::endl;
+            return false;
+        }
+        if (level.next != kMemory && find_level(levels, level.next) == -1) {
+            std::cerr << "Level " << level.name << " points to unknown level " << level.next << std::endl;
+            return false;
+        }
+        // following next from any level must reach memory
+        std::string next = level.next;
+        for (size_t steps = 0; next != kMemory; steps++) {
+            if (steps == levels.size()) {
+                std::cerr << "Hierarchy has a cycle through " << level.name << std::endl;
+                return false;
+            }
+            next = levels[find_level(levels, next)].next;
+        }
+        if ((level.victim_entries != 0 || level.write_buffer_entries != 0) && level.next != kMemory &&
+            levels[find_level(levels, level.next)].inclusion == EXCLUSIVE) {
+            std::cerr << "Level " << level.next << " is exclusive, " << level.name
+                << " can't have a victim cache or write buffer" << std::endl;
+            return false;
+        }
+        if (level.next != kMemory && level.block_size != levels[find_level(levels, level.next)].block_size &&
+            levels[find_level(levels, level.next)].inclusion == EXCLUSIVE) {
+            std::cerr << "Level " << level.next << " is exclusive, its block size must match " << level.name << std::endl;
+            return false;
+        }
+        optimal = optimal || level.replacement == OPTIMAL;
+        if (level.prefetch && level.replacement == OPTIMAL) {
+            std::cerr << "Level " << level.name << " is OPTIMAL, it can't prefetch!" << std::endl;
+            return false;
+        }
+
+        // an exclusive level is filled by victims only, a prefetch could duplicate a block above
+        if (level.prefetch && level.inclusion == EXCLUSIVE && !is_first_level(levels, level)) {
+            std::cerr << "Level " << level.name << " is exclusive, it can't prefetch!" << std::endl;
+            return false;
+        }
+
+        if (is_first_level(levels, level)) {
+            first_levels++;
+            instruction_levels += level.role != SERVES_DATA;
+            data_levels += level.role != SERVES_INSTRUCTIONS;
+        } else if (level.role != SERVES_UNIFIED) {
+            std::cerr << "Only a first level serves the CPU: " << level.name << std::endl;
+            return false;
+        }
+    }
+    if (data_levels != 1 || instruction_levels != 1) {
+        std::cerr << "Hierarchy needs one first level for data and one for instructions (or one unified)!" << std::endl;
+        return false;
+    }
+    // OPT knows the future of the trace at one block size, through a single first level
+    if (optimal && (first_levels != 1 || std::any_of(levels.begin(), levels.end(),
+        [&](const LevelConfig &level) { return level.block_size != levels[0].block_size; }))) {
+        std::cerr << "OPTIMAL needs a unified first level and one block size!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool read_hierarchy_file(const std::string &path, std::vector<LevelConfig> &levels) {
+    std::ifstream infile(path);
+    if (!infile.is_open()) {
+        std::cerr << "Invalid hierarchy file!" << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(infile, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        LevelConfig level;
+        if (!parse_level(line, level)) {
+            std::cerr << "Invalid hierarchy line: " << line << std::endl;
+            return false;
+        }
+        levels.push_back(level);
+    }
+    return check_hierarchy(levels);
+}
+
+void run_hierarchy(const std::vector<LevelConfig> &levels, const std::string &trace_file, uint64_t seed,
+    const std::optional<TimingOptions> &timing, bool classify_misses) {
+    std::vector<std::shared_ptr<Cache>> caches;
+    for (size_t i = 0; i < levels.size(); i++) {
+        const LevelConfig &level = levels[i];
+        caches.push_back(std::make_shared<Cache>(level.size, level.block_size, level.associativity,
+            level.replacement, level.inclusion));
+        caches.back()->set_seed(seed + i);
+        if (level.prefetch) {
+            caches.back()->set_prefetcher(*level.prefetch);
+        }
+        if (level.victim_entries != 0) {
+            caches.back()->set_victim_cache(level.victim_entries);
+        }
+        if (level.write_buffer_entries != 0) {
+            caches.back()->set_write_buffer(level.write_buffer_entries);
+        }
+        if (timing) {
+            int latency = level.latency != 0 ? level.latency : timing->latencies.cache_latency(level.size, level.associativity);
+            caches.back()->set_latency(latency, timing->latencies.memory_latency());
+        }
+        if (classify_misses) {
+            caches.back()->classify_misses();
+        }
+    }
+    std::shared_ptr<Cache> instruction;
+    std::shared_ptr<Cache> data;
+    for (size_t i = 0; i < levels.size(); i++) {
+        const LevelConfig &level = levels[i];
+        if (level.next != kMemory) {
+            std::shared_ptr<Cache> child = caches[find_level(levels, level.next)];
+            caches[i]->set_child(child);
+            child->add_parent(caches[i]);
+        }
+        if (is_first_level(levels, level)) {
+            if (level.role != SERVES_DATA) {
+                instruction = caches[i];
+            }
+            if (level.role != SERVES_INSTRUCTIONS) {
+                data = caches[i];
+            }
+        }
+    }
+
+    std::cout << "===== Simulator configuration =====" << std::endl;
+    for (const LevelConfig &level : levels) {
+        std::string description = std::format("{} B, {}-way, {} B blocks, {}, {}", level.size, level.associativity,
+            level.block_size, replacement_names[level.replacement], inclusion_names[level.inclusion]);
+        if (is_first_level(levels, level)) {
+            description += std::format(", serves {}", role_names[level.role]);
+        }
+        if (level.prefetch) {
+            description += ", prefetch " + describe_prefetch_config(*level.prefetch);
+        }
+        if (level.victim_entries != 0) {
+            description += std::format(", {}-entry victim cache", level.victim_entries);
+        }
+        if (level.write_buffer_entries != 0) {
+            description += std::format(", {}-entry write buffer", level.write_buffer_entries);
+        }
+        if (level.latency != 0) {
+            description += std::format(", {}-cycle hits", level.latency);
+        }
+        std::cout << std::format("{:<23}", level.name + ":") << description << ", next " << level.next << std::endl;
+    }
+    if (timing) {
+        std::cout << std::format("{:<23}", "LATENCIES:") << timing->latencies.get_source() << std::endl;
+        if (timing->mshrs != 0) {
+            std::cout << std::format("{:<23}", "MSHRS:") << timing->mshrs << std::endl;
+        }
+    }
+    std::cout << std::format("{:<23}", "trace_file:") << fs::path(trace_file).filename().string() << std::endl;
+
+    // OPT looks ahead, so the trace is read once for the next use of every record
+    std::optional<NextUse> next_use;
+    if (std::any_of(levels.begin(), levels.end(), [](const LevelConfig &level) { return level.replacement == OPTIMAL; })) {
+        next_use.emplace(levels[0].block_size);
+        if (!next_use->build(trace_file)) {
+            std::cerr << "Invalid trace file!" << std::endl;
+            exit(1);
+        }
+        data->set_next_use(&*next_use);
+    }
+
+    TraceReader reader(trace_file);
+    if (!reader.is_open()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    std::optional<TimingModel> timing_model;
+    if (timing) {
+        timing_model.emplace(timing->mshrs);
+    }
+    std::vector<MemoryRecord> batch(TraceReader::kBatchSize);
+    while (size_t count = reader.read_memory(batch.data(), batch.size())) {
+        for (size_t i = 0; i < count; ++i) {
+            const MemoryRecord &record = batch[i];
+            int cycles;
+            const Cache *first;
+            if (record.op == 'r') {
+                cycles = data->read(record.address);
+                first = data.get();
+            } else if (record.op == 'w') {
+                cycles = data->write(record.address);
+                first = data.get();
+            } else if (record.op == 'i') {
+                cycles = instruction->read(record.address);
+                first = instruction.get();
+            } else {
+                std::cerr << "Invalid operation!" << std::endl;
+                exit(1);
+            }
+            if (timing_model) {
+                timing_model->access(cycles, first->get_hit_latency());
+            }
+        }
+    }
+    if (reader.failed()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    // a level drains into the one below it, so the levels furthest from memory drain first
+    std::vector<size_t> to_memory(levels.size(), 0);
+    for (size_t i = 0; i < levels.size(); i++) {
+        for (std::string next = levels[i].next; next != kMemory; next = levels[find_level(levels, next)].next) {
+            to_memory[i]++;
+        }
+    }
+    for (size_t steps = levels.size(); steps-- > 0;) {
+        for (size_t i = 0; i < levels.size(); i++) {
+            if (to_memory[i] == steps) {
+                caches[i]->drain_write_buffer();
+            }
+        }
+    }
+
+    for (size_t i = 0; i < levels.size(); i++) {
+        caches[i]->print_cache(levels[i].name + " contents");
+    }
+    std::cout << "===== Simulation results (raw) =====" << std::endl;
+    size_t longest_name = 0;
+    for (const LevelConfig &level : levels) {
+        longest_name = std::max(longest_name, level.name.size());
+    }
+    int width = Cache::label_width(longest_name);
+    char start_char = 'a';
+    uint64_t traffic = 0;
+    for (size_t i = 0; i < levels.size(); i++) {
+        caches[i]->print_summary(levels[i].name, start_char, width);
+        start_char += 6;
+        // every path to memory ends in a level without a next one
+        if (levels[i].next == kMemory) {
+            traffic += caches[i]->get_memory_traffic();
+        }
+    }
+    Cache::print_traffic(traffic, start_char, width);
+
+    if (std::any_of(levels.begin(), levels.end(), [](const LevelConfig &level) { return level.prefetch.has_value(); })) {
+        std::cout << "===== Prefetch results =====" << std::endl;
+        start_char = 'a';
+        for (size_t i = 0; i < levels.size(); i++) {
+            if (levels[i].prefetch) {
+                caches[i]->print_prefetch_summary(levels[i].name, start_char, width);
+                start_char += 6;
+            }
+        }
+    }
+    if (std::any_of(levels.begin(), levels.end(), [](const LevelConfig &level) {
+        return level.victim_entries != 0 || level.write_buffer_entries != 0;
+    })) {
+        std::cout << "===== Victim cache and write buffer results =====" << std::endl;
+        start_char = 'a';
+        for (size_t i = 0; i < levels.size(); i++) {
+            start_char = caches[i]->print_buffer_summary(levels[i].name, start_char, width);
+        }
+    }
+    if (timing_model) {
+        std::cout << "===== Timing results =====" << std::endl;
+        start_char = 'a';
+        uint64_t memory_cycles = 0;
+        for (size_t i = 0; i < levels.size(); i++) {
+            start_char = caches[i]->print_timing_summary(levels[i].name, start_char, width);
+            memory_cycles += caches[i]->get_timing_stats().memory_cycles;
+        }
+        timing_model->print_summary(timing->latencies.memory_latency(), memory_cycles, start_char, width);
+    }
+    if (classify_misses) {
+        std::cout << "===== Miss classification =====" << std::endl;
+        start_char = 'a';
+        for (size_t i = 0; i < levels.size(); i++) {
+            start_char = caches[i]->print_miss_classification(levels[i].name, start_char, width);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "set.h"
+#include "prefetch.h"
+#include "timing.h"
+
+// what the CPU sends to a first level cache
+enum LevelRole {
+    SERVES_UNIFIED,
+    SERVES_INSTRUCTIONS,
+    SERVES_DATA,
+};
+
+// one line of a hierarchy file
+struct LevelConfig {
+    std::string name;
+    int size;
+    int associativity;
+    int block_size;
+    ReplacementPolicy replacement;
+    // relation to the levels above, unused for a first level
+    InclusionPolicy inclusion;
+    // name of the next level, or "memory"
+    std::string next;
+    // first levels only
+    LevelRole role;
+    std::optional<PrefetchConfig> prefetch;
+    // entries of the victim cache and write buffer in front of next, 0 for none
+    int victim_entries = 0;
+    int write_buffer_entries = 0;
+    // hit latency in cycles for --timing, 0 to take it from the latency table
+    int latency = 0;
+};
+
+// A hierarchy file has one line per cache, blank lines and lines starting with '#' are skipped:
+//   <NAME> <SIZE> <ASSOC> <BLOCKSIZE> <REPLACEMENT> <INCLUSION> <NEXT> [<SERVES>] [<option>=<value>]...
+// REPLACEMENT is LRU, FIFO, RANDOM, OPTIMAL, SRRIP, BRRIP, DRRIP or PLRU, INCLUSION is non-inclusive, inclusive or exclusive,
+// NEXT is the name of the level below or memory. A level no other level points to is a first
+// level, SERVES says what it caches: unified (default), instruction or data. The options of any
+// level are prefetch=<spec> (see parse_prefetch_config), victim=<entries> for a victim cache,
+// write_buffer=<entries> for a write buffer in front of NEXT, and latency=<cycles> for the hit
+// latency of --timing instead of the one from the latency table. e.g.
+//   L1I 32768  8  64 LRU non-inclusive L2 instruction
+//   L1D 32768  8  64 LRU non-inclusive L2 data victim=8 write_buffer=8
+//   L2  262144 8  64 LRU non-inclusive L3 prefetch=stream,8,4 latency=10
+//   L3  2097152 16 64 LRU inclusive memory
+// Return false and print the reason if the file can't be read or the hierarchy is invalid.
+bool read_hierarchy_file(const std::string &path, std::vector<LevelConfig> &levels);
+
+// Build the caches, run the trace through them and print the configuration, contents and
+// per level counters. 'r' and 'w' records go to the data (or unified) first level, 'i' records
+// are instruction fetches and read the instruction (or unified) first level.
+// Level i of the file seeds its RANDOM generator with seed + i. With timing, also print the
+// cycles of the run, the CPU issuing every access to the first level that serves it. With
+// classify_misses, also print the compulsory, capacity and conflict misses of every level.
+void run_hierarchy(const std::vector<LevelConfig> &levels, const std::string &trace_file, uint64_t seed,
+    const std::optional<TimingOptions> &timing, bool classify_misses);
+
+#endif // HIERARCHY_H
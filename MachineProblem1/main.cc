@@ -1,22 +1,254 @@
 #include <iostream>
 #include <getopt.h>
 #include <format>
-#include <fstream>
 #include <sstream>
+#include <vector>
 #include "cache.h"
+#include "trace_reader.h"
+#include "sweep.h"
+#include "hierarchy.h"
+#include "multicore.h"
+#include "pipeline.h"
+#include "sampling.h"
+#include "checkpoint.h"
+#include "sharded.h"
+#include "stack_distance.h"
+#include "tag_match.h"
+#include "timing.h"
 #include <filesystem>
+#include <optional>
+#include <thread>
 
 namespace fs = std::filesystem;
 
 namespace {
 
 void usage(const std::string& program_name) {
-    std::cerr << "Usage: " << program_name << " <BLOCKSIZE> <L1_SIZE> <L1_ASSOC> <L2_SIZE> <L2_ASSOC> <REPLACEMENT_POLICY> <INCLUSION_PROPERTY> <trace_ﬁle>" << std::endl;
+    std::cerr << "Usage: " << program_name << " [-p [-j <threads>] | --pipeline | --sample <plan>] <BLOCKSIZE> <L1_SIZE> <L1_ASSOC> <L2_SIZE> <L2_ASSOC> <REPLACEMENT_POLICY> <INCLUSION_PROPERTY> <trace_ﬁle>" << std::endl;
+    std::cerr << "  -p  shard the sets of each cache over the -j threads, LRU or FIFO with a non-inclusive L2" << std::endl;
+    std::cerr << "  --sample <period>,<window>[,<warmup>]  estimate the miss rates from the last window records of" << std::endl;
+    std::cerr << "      every period, after warmup records of warming (default the rest of the period)" << std::endl;
+    std::cerr << "  --save <N>,<file>  write the cache state after N records, --restore <file> goes on from it" << std::endl;
+    std::cerr << "  --pipeline  decode, L1 and L2 on their own threads, a non-inclusive L2 and no OPTIMAL" << std::endl;
+    std::cerr << "  --prefetch <L1|L2>:<spec>  attach a prefetcher to a level, spec is next,<N>, stride,<entries>,<degree>" << std::endl;
+    std::cerr << "      or stream,<streams>,<depth>, each with an optional ,<latency> in accesses for late prefetches" << std::endl;
+    std::cerr << "  --victim-cache <entries>  fully associative victim cache between L1 and L2" << std::endl;
+    std::cerr << "  --write-buffer <entries>  coalescing write buffer for the L1 writebacks" << std::endl;
+    std::cerr << "  --timing <builtin|latency_file>  cycles and AMAT, each level's latency from its size and associativity," << std::endl;
+    std::cerr << "      a latency file has \"<SIZE> <ASSOC> <CYCLES>\" and \"memory <CYCLES>\" lines (see timing.h)" << std::endl;
+    std::cerr << "  --mshr <n>  with --timing, up to n misses outstanding instead of a CPU blocking on each" << std::endl;
+    std::cerr << "  --3c  split the misses of each level into compulsory, capacity and conflict ones" << std::endl;
+    std::cerr << "       " << program_name << " [-s <grid_file>] [-g <grid>] [-j <threads>] [-o csv|json] <trace_file>" << std::endl;
+    std::cerr << "  sweep mode, a grid has the 7 configuration fields, each a list of values or lo:hi powers of 2" << std::endl;
+    std::cerr << "  e.g. -g \"16 1024:8192 1,2,4 0 0 0 0\"" << std::endl;
+    std::cerr << "       " << program_name << " -d <BLOCKSIZE>,<SETS>[,<MAX_ASSOC>] <trace_file>" << std::endl;
+    std::cerr << "  LRU stack distance, L1 misses of every associativity up to MAX_ASSOC (default 64) in one pass" << std::endl;
+    std::cerr << "       " << program_name << " -c <hierarchy_file> <trace_file>" << std::endl;
+    std::cerr << "  any number of levels, split L1s, see hierarchy.h for the file format. Takes --timing, --mshr and --3c" << std::endl;
+    std::cerr << "       " << program_name << " -m <cores> [-j <threads>] <BLOCKSIZE> <L1_SIZE> <L1_ASSOC> <L2_SIZE> <L2_ASSOC> <REPLACEMENT_POLICY> <INCLUSION_PROPERTY> <trace_file>..." << std::endl;
+    std::cerr << "  private L1 per core kept coherent with MESI, shared L2. One trace per core," << std::endl;
+    std::cerr << "  or one trace with the core as a last column: \"r 7b032a 3\"" << std::endl;
+    std::cerr << "  --quantum <n>  accesses a core runs alone before its bus requests are interleaved (default 256)" << std::endl;
+    std::cerr << "  REPLACEMENT_POLICY: 0 LRU, 1 FIFO, 2 RANDOM, 3 OPTIMAL (Belady), 4 SRRIP, 5 BRRIP, 6 DRRIP (set dueling)," << std::endl;
+    std::cerr << "      7 PLRU (tree pseudo-LRU, a power of 2 associativity)" << std::endl;
+    std::cerr << "  --seed <n>  seed of the RANDOM, BRRIP and DRRIP replacement generator (default 0)" << std::endl;
+    std::cerr << "  -S  use the scalar tag lookup instead of SIMD" << std::endl;
+}
+
+void run_stack_distance(const std::string &spec, const std::string &trace_file) {
+    int block_size, set_count, max_assoc = 64;
+    char comma1, comma2;
+    std::istringstream iss(spec);
+    if (!(iss >> block_size >> comma1 >> set_count) || comma1 != ',' ||
+        (!iss.eof() && (!(iss >> comma2 >> max_assoc) || comma2 != ',')) || max_assoc < 1) {
+        std::cerr << "Invalid stack distance spec: " << spec << std::endl;
+        exit(1);
+    }
+    StackDistance stack_distance(block_size, set_count, max_assoc);
+
+    TraceReader reader(trace_file);
+    if (!reader.is_open()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    std::vector<MemoryRecord> batch(TraceReader::kBatchSize);
+    while (size_t count = reader.read_memory(batch.data(), batch.size())) {
+        for (size_t i = 0; i < count; ++i) {
+            if (batch[i].op == 'r') {
+                stack_distance.read(batch[i].address);
+            } else if (batch[i].op == 'w') {
+                stack_distance.write(batch[i].address);
+            } else {
+                std::cerr << "Invalid operation!" << std::endl;
+                exit(1);
+            }
+        }
+    }
+    if (reader.failed()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    std::cout << std::format("{:<23}", "trace_file:") << fs::path(trace_file).filename().string() << std::endl;
+    stack_distance.print_curve();
+}
+
+// write the state of l1 (and l2) once they have seen records trace records
+void save_checkpoint(const std::string &path, uint64_t records, const Cache &l1, const Cache *l2) {
+    CheckpointWriter out(CHECKPOINT_CACHE, records);
+    out.put<uint8_t>(l2 != nullptr);
+    l1.save(out);
+    if (l2 != nullptr) {
+        l2->save(out);
+    }
+    if (!out.save(path)) {
+        std::cerr << "Can't write checkpoint " << path << std::endl;
+        exit(1);
+    }
+}
+
+// load the state written by save_checkpoint, return the trace records it has seen
+uint64_t restore_checkpoint(const std::string &path, Cache &l1, Cache *l2) {
+    CheckpointReader in(path, CHECKPOINT_CACHE);
+    if (!in.expect<uint8_t>(l2 != nullptr) || !l1.load(in) || (l2 != nullptr && !l2->load(in)) || !in.at_end()) {
+        std::cerr << "Invalid checkpoint for this configuration: " << path << std::endl;
+        exit(1);
+    }
+    return in.records();
+}
+
+// open the trace, past the records a restored checkpoint has seen
+void open_trace(TraceReader &reader, uint64_t start) {
+    if (!reader.is_open()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    if (reader.skip(start) != start) {
+        std::cerr << "The checkpoint is past the end of the trace!" << std::endl;
+        exit(1);
+    }
+}
+
+// estimate the L1 and L2 miss rates from the windows of plan, from record start on
+void run_sampled_cache(Cache &l1, Cache *l2, const std::string &trace_file, const SamplingPlan &plan, uint64_t start) {
+    TraceReader reader(trace_file);
+    open_trace(reader, start);
+    RatioEstimate l1_rate;
+    RatioEstimate l2_rate;
+    CacheStats l1_start;
+    CacheStats l2_start;
+    uint64_t simulated = 0;
+    uint64_t total = start + run_sampled<MemoryRecord>(reader, plan,
+        [&](const MemoryRecord &record) {
+            ++simulated;
+            if (record.op == 'r') {
+                l1.read(record.address);
+            } else if (record.op == 'w') {
+                l1.write(record.address);
+            } else {
+                std::cerr << "Invalid operation!" << std::endl;
+                exit(1);
+            }
+        },
+        [&]() {
+            l1_start = l1.get_stats();
+            if (l2 != nullptr) {
+                l2_start = l2->get_stats();
+            }
+        },
+        [&]() {
+            // the L1 rate is over all accesses, the L2 one over reads, as in print_summary
+            CacheStats now = l1.get_stats();
+            l1_rate.add(now.read_misses + now.write_misses - l1_start.read_misses - l1_start.write_misses,
+                now.reads + now.writes - l1_start.reads - l1_start.writes);
+            if (l2 != nullptr) {
+                now = l2->get_stats();
+                l2_rate.add(now.read_misses - l2_start.read_misses, now.reads - l2_start.reads);
+            }
+        });
+    if (reader.failed()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "===== Sampled results (95% confidence) =====" << std::endl;
+    std::cout << "a. " << std::format("{:<27}", "number of windows:") << l1_rate.samples() << std::endl;
+    std::cout << "b. " << std::format("{:<27}", "simulated records:") << simulated << " of " << total << std::endl;
+    std::cout << "c. " << std::format("{:<27}", "L1 miss rate:")
+        << std::format("{:.6f} +- {:.6f}", l1_rate.ratio(), l1_rate.half_width()) << std::endl;
+    std::cout << "d. " << std::format("{:<27}", "L2 miss rate:");
+    if (l2 != nullptr) {
+        std::cout << std::format("{:.6f} +- {:.6f}", l2_rate.ratio(), l2_rate.half_width()) << std::endl;
+    } else {
+        std::cout << 0 << std::endl;
+    }
+}
+
+// "L1:<spec>" or "L2:<spec>" of --prefetch
+bool parse_level_prefetch(const std::string &arg, std::optional<PrefetchConfig> (&prefetch)[2]) {
+    if (arg.size() < 3 || arg[0] != 'L' || (arg[1] != '1' && arg[1] != '2') || arg[2] != ':') {
+        return false;
+    }
+    PrefetchConfig config;
+    if (!parse_prefetch_config(arg.substr(3), config)) {
+        return false;
+    }
+    prefetch[arg[1] - '1'] = config;
+    return true;
+}
+
+void run_multicore(int cores, int threads, size_t quantum, uint64_t seed, char *args[], int arg_count) {
+    if (arg_count < 8) {
+        std::cerr << "Multicore mode takes the 7 configuration fields and the trace files!" << std::endl;
+        exit(1);
+    }
+    int fields[5];
+    try {
+        for (int i = 0; i < 5; i++) {
+            fields[i] = std::stoi(args[i]);
+        }
+    } catch (std::exception const &) {
+        std::cerr << "Invalid configuration!" << std::endl;
+        exit(1);
+    }
+    std::string replacement_policy(args[5]);
+    std::string inclusion_policy(args[6]);
+    if ((replacement_policy != "0" && replacement_policy != "2") || (inclusion_policy != "0" && inclusion_policy != "1")) {
+        std::cerr << "Multicore runs support LRU (0) or RANDOM (2), non-inclusive (0) or inclusive (1)!" << std::endl;
+        exit(1);
+    }
+    if (fields[3] == 0) {
+        std::cerr << "Multicore runs need a shared L2!" << std::endl;
+        exit(1);
+    }
+    std::vector<std::string> trace_files(args + 7, args + arg_count);
+
+    std::cout << "===== Simulator configuration =====" << std::endl;
+    std::cout << std::format("{:<23}", "CORES:") << cores << std::endl;
+    std::cout << std::format("{:<23}", "BLOCKSIZE:") << fields[0] << std::endl;
+    std::cout << std::format("{:<23}", "L1_SIZE:") << fields[1] << std::endl;
+    std::cout << std::format("{:<23}", "L1_ASSOC:") << fields[2] << std::endl;
+    std::cout << std::format("{:<23}", "L2_SIZE:") << fields[3] << std::endl;
+    std::cout << std::format("{:<23}", "L2_ASSOC:") << fields[4] << std::endl;
+    std::cout << std::format("{:<23}", "REPLACEMENT POLICY:") << (replacement_policy == "0" ? "LRU" : "RANDOM") << std::endl;
+    std::cout << std::format("{:<23}", "INCLUSION PROPERTY:") << (inclusion_policy == "0" ? "non-inclusive" : "inclusive") << std::endl;
+    for (const std::string &trace_file : trace_files) {
+        std::cout << std::format("{:<23}", "trace_file:") << fs::path(trace_file).filename().string() << std::endl;
+    }
+
+    MulticoreSystem system(cores, fields[0], fields[1], fields[2], fields[3], fields[4],
+        replacement_policy == "0" ? LRU : RANDOM, inclusion_policy == "0" ? NON_INCLUSIVE : INCLUSIVE, seed, quantum);
+    system.run(trace_files, threads);
+    system.print_results();
 }
 
 } // namespace
 
 // ./sim_cache 16 1024 2 0 0 0 0 ./traces/gcc_trace.txt
+// ./sim_cache -p -j 8 16 1024 2 8192 4 0 0 ./traces/gcc_trace.txt
+// ./sim_cache -g "16,32 1024:65536 1:8 0 0 0 0" -j 8 ./traces/gcc_trace.txt
+// ./sim_cache -d 16,32,16 ./traces/gcc_trace.txt
+// ./sim_cache -c ./hierarchies/three_level.txt ./traces/gcc_trace.txt
+// ./sim_cache -m 2 16 1024 2 8192 4 0 1 ./traces/gcc_trace.txt ./traces/go_trace.txt
 
 int main(int argc, char* argv[]) {
 
@@ -25,9 +257,153 @@ int main(int argc, char* argv[]) {
     // }
 
     // Parse the command line arguments
+    std::vector<SweepConfig> sweep_configs;
+    bool sweep = false;
+    std::string stack_distance_spec;
+    std::vector<LevelConfig> levels;
+    int cores = 0;
+    bool sharded = false;
+    bool pipelined = false;
+    SamplingPlan sample_plan;
+    CheckpointOptions checkpoint;
+    // the prefetchers of L1 and L2
+    std::optional<PrefetchConfig> prefetch[2];
+    // entries of the L1 victim cache and write buffer, 0 for none
+    int victim_entries = 0;
+    int write_buffer_entries = 0;
+    std::optional<TimingOptions> timing;
+    int mshrs = 0;
+    bool classify_misses = false;
+    size_t quantum = MulticoreSystem::kDefaultQuantum;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    SweepFormat sweep_format = SWEEP_CSV;
     int opt;
-    while ((opt = getopt(argc, argv, "h")) != -1) {
+    uint64_t seed = 0;
+    static const option long_options[] = {
+        {"seed", required_argument, nullptr, 'r'},
+        {"quantum", required_argument, nullptr, 'q'},
+        {"pipeline", no_argument, nullptr, 'P'},
+        {"sample", required_argument, nullptr, 'a'},
+        {"save", required_argument, nullptr, 'k'},
+        {"restore", required_argument, nullptr, 'e'},
+        {"prefetch", required_argument, nullptr, 'f'},
+        {"victim-cache", required_argument, nullptr, 'V'},
+        {"write-buffer", required_argument, nullptr, 'W'},
+        {"timing", required_argument, nullptr, 't'},
+        {"mshr", required_argument, nullptr, 'M'},
+        {"3c", no_argument, nullptr, '3'},
+        {nullptr, 0, nullptr, 0},
+    };
+    while ((opt = getopt_long(argc, argv, "hs:g:j:o:d:Sc:m:p", long_options, nullptr)) != -1) {
         switch (opt) {
+            case 'r':
+                try {
+                    seed = std::stoull(optarg);
+                } catch (std::exception const &) {
+                    std::cerr << "Invalid seed!" << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'q':
+                quantum = std::max(1, atoi(optarg));
+                break;
+            case 's':
+                sweep = true;
+                if (!read_sweep_file(optarg, sweep_configs)) {
+                    std::cerr << "Invalid sweep file!" << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'g':
+                sweep = true;
+                if (!parse_sweep_grid(optarg, sweep_configs)) {
+                    std::cerr << "Invalid sweep grid: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'd':
+                stack_distance_spec = optarg;
+                break;
+            case 'm':
+                cores = atoi(optarg);
+                if (cores < 1) {
+                    std::cerr << "Invalid core count!" << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'c':
+                if (!read_hierarchy_file(optarg, levels)) {
+                    exit(1);
+                }
+                break;
+            case 'p':
+                sharded = true;
+                break;
+            case 'P':
+                pipelined = true;
+                break;
+            case 'k':
+                if (!parse_checkpoint_save(optarg, checkpoint)) {
+                    std::cerr << "Invalid checkpoint: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'e':
+                checkpoint.restore_path = optarg;
+                break;
+            case 'f':
+                if (!parse_level_prefetch(optarg, prefetch)) {
+                    std::cerr << "Invalid prefetcher: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'a':
+                if (!parse_sampling_plan(optarg, sample_plan)) {
+                    std::cerr << "Invalid sampling plan: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'V':
+            case 'W':
+                (opt == 'V' ? victim_entries : write_buffer_entries) = atoi(optarg);
+                if ((opt == 'V' ? victim_entries : write_buffer_entries) < 1) {
+                    std::cerr << "Invalid entry count: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case 't':
+                timing.emplace();
+                if (std::string(optarg) != "builtin" && !timing->latencies.read_file(optarg)) {
+                    exit(1);
+                }
+                break;
+            case 'M':
+                mshrs = atoi(optarg);
+                if (mshrs < 1) {
+                    std::cerr << "Invalid MSHR count: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case '3':
+                classify_misses = true;
+                break;
+            case 'S':
+                // scalar tag lookup, for checking the SIMD one
+                use_simd_tag_lookup(false);
+                break;
+            case 'j':
+                threads = std::max(1, atoi(optarg));
+                break;
+            case 'o':
+                if (std::string(optarg) == "csv") {
+                    sweep_format = SWEEP_CSV;
+                } else if (std::string(optarg) == "json") {
+                    sweep_format = SWEEP_JSON;
+                } else {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
             case 'h':
                 usage(argv[0]);
                 exit(0);
@@ -36,6 +412,52 @@ int main(int argc, char* argv[]) {
                 exit(1);
         }
     }
+    if (mshrs != 0 && !timing) {
+        std::cerr << "--mshr needs --timing!" << std::endl;
+        exit(1);
+    }
+    if (timing) {
+        timing->mshrs = mshrs;
+    }
+    if (timing && (sweep || cores != 0 || !stack_distance_spec.empty())) {
+        std::cerr << "Timing is for a single configuration or a hierarchy file!" << std::endl;
+        exit(1);
+    }
+    if (classify_misses && (sweep || cores != 0 || !stack_distance_spec.empty())) {
+        std::cerr << "Miss classification is for a single configuration or a hierarchy file!" << std::endl;
+        exit(1);
+    }
+    if (!stack_distance_spec.empty()) {
+        if (argc - optind != 1) {
+            std::cerr << "Stack distance mode takes only the trace file!" << std::endl;
+            usage(argv[0]);
+            exit(1);
+        }
+        run_stack_distance(stack_distance_spec, argv[optind]);
+        return 0;
+    }
+    if (cores != 0) {
+        run_multicore(cores, threads, quantum, seed, argv + optind, argc - optind);
+        return 0;
+    }
+    if (!levels.empty()) {
+        if (argc - optind != 1) {
+            std::cerr << "Hierarchy mode takes only the trace file!" << std::endl;
+            usage(argv[0]);
+            exit(1);
+        }
+        run_hierarchy(levels, argv[optind], seed, timing, classify_misses);
+        return 0;
+    }
+    if (sweep) {
+        if (argc - optind != 1) {
+            std::cerr << "Sweep mode takes only the trace file!" << std::endl;
+            usage(argv[0]);
+            exit(1);
+        }
+        run_sweep(sweep_configs, argv[optind], threads, seed, sweep_format, std::cout);
+        return 0;
+    }
     if (argc - optind != 8) {
         std::cerr << "Argument count must be 8!" << std::endl;
         usage(argv[0]);
@@ -68,7 +490,28 @@ int main(int argc, char* argv[]) {
         std::cout << std::format("{:<23}", "L1_ASSOC:") << l1_assoc << std::endl;
         std::cout << std::format("{:<23}", "L2_SIZE:") << l2_size << std::endl;
         std::cout << std::format("{:<23}", "L2_ASSOC:") << l2_assoc << std::endl;
-        std::cout << std::format("{:<23}", "REPLACEMENT POLICY:") << (replacement_policy == "0" ? "LRU" : "FIFO") << std::endl;
+        std::string replacement_print;
+        if (replacement_policy == "0") {
+            replacement_print = "LRU";
+        } else if (replacement_policy == "1") {
+            replacement_print = "FIFO";
+        } else if (replacement_policy == "2") {
+            replacement_print = "RANDOM";
+        } else if (replacement_policy == "3") {
+            replacement_print = "OPTIMAL";
+        } else if (replacement_policy == "4") {
+            replacement_print = "SRRIP";
+        } else if (replacement_policy == "5") {
+            replacement_print = "BRRIP";
+        } else if (replacement_policy == "6") {
+            replacement_print = "DRRIP";
+        } else if (replacement_policy == "7") {
+            replacement_print = "PLRU";
+        } else {
+            std::cerr << "Invalid replacement policy!" << std::endl;
+            exit(1);
+        }
+        std::cout << std::format("{:<23}", "REPLACEMENT POLICY:") << replacement_print << std::endl;
         std::string inclusion_print;
         if (inclusion_policy == "0") {
             inclusion_print = "non-inclusive";
@@ -81,6 +524,24 @@ int main(int argc, char* argv[]) {
             exit(1);
         }
         std::cout << std::format("{:<23}", "INCLUSION PROPERTY:") << inclusion_print << std::endl;
+        if (victim_entries != 0) {
+            std::cout << std::format("{:<23}", "L1_VICTIM_CACHE:") << victim_entries << std::endl;
+        }
+        if (write_buffer_entries != 0) {
+            std::cout << std::format("{:<23}", "L1_WRITE_BUFFER:") << write_buffer_entries << std::endl;
+        }
+        for (int level = 0; level < 2; level++) {
+            if (prefetch[level]) {
+                std::cout << std::format("{:<23}", std::format("L{}_PREFETCHER:", level + 1))
+                    << describe_prefetch_config(*prefetch[level]) << std::endl;
+            }
+        }
+        if (timing) {
+            std::cout << std::format("{:<23}", "LATENCIES:") << timing->latencies.get_source() << std::endl;
+            if (mshrs != 0) {
+                std::cout << std::format("{:<23}", "MSHRS:") << mshrs << std::endl;
+            }
+        }
         std::cout << std::format("{:<23}", "trace_file:") << fs::path(trace_file).filename().string() << std::endl;
 
         ReplacementPolicy replacement;
@@ -88,6 +549,18 @@ int main(int argc, char* argv[]) {
             replacement = LRU;
         } else if (replacement_policy == "1") {
             replacement = FIFO;
+        } else if (replacement_policy == "2") {
+            replacement = RANDOM;
+        } else if (replacement_policy == "3") {
+            replacement = OPTIMAL;
+        } else if (replacement_policy == "4") {
+            replacement = SRRIP;
+        } else if (replacement_policy == "5") {
+            replacement = BRRIP;
+        } else if (replacement_policy == "6") {
+            replacement = DRRIP;
+        } else if (replacement_policy == "7") {
+            replacement = PLRU;
         } else {
             std::cerr << "Invalid replacement policy!" << std::endl;
             exit(1);
@@ -104,56 +577,223 @@ int main(int argc, char* argv[]) {
             exit(1);
         }
 
+        if (sample_plan.period != 0 && (sharded || pipelined || replacement == OPTIMAL)) {
+            std::cerr << "Sampled runs don't support -p, --pipeline or OPTIMAL replacement!" << std::endl;
+            exit(1);
+        }
+        // the sharded and pipelined caches aren't the Cache objects of a serial run
+        if ((!checkpoint.save_path.empty() || !checkpoint.restore_path.empty()) && (sharded || pipelined)) {
+            std::cerr << "Checkpoints don't support -p or --pipeline!" << std::endl;
+            exit(1);
+        }
+        // prefetchers run in the Cache objects of a serial run, and aren't saved in checkpoints
+        if ((prefetch[0] || prefetch[1]) && (sharded || pipelined || !checkpoint.save_path.empty() ||
+            !checkpoint.restore_path.empty())) {
+            std::cerr << "Prefetchers don't support -p, --pipeline or checkpoints!" << std::endl;
+            exit(1);
+        }
+        bool buffers = victim_entries != 0 || write_buffer_entries != 0;
+        if (buffers && (sharded || pipelined || !checkpoint.save_path.empty() || !checkpoint.restore_path.empty())) {
+            std::cerr << "Victim caches and write buffers don't support -p, --pipeline or checkpoints!" << std::endl;
+            exit(1);
+        }
+        // an exclusive L2 takes every L1 victim itself
+        if (buffers && l2_size != 0 && inclusion == EXCLUSIVE) {
+            std::cerr << "Victim caches and write buffers need a non-exclusive L2!" << std::endl;
+            exit(1);
+        }
+        if (prefetch[1] && l2_size == 0) {
+            std::cerr << "No L2 to attach a prefetcher to!" << std::endl;
+            exit(1);
+        }
+        if ((prefetch[0] || prefetch[1]) && replacement == OPTIMAL) {
+            std::cerr << "OPTIMAL replacement can't prefetch!" << std::endl;
+            exit(1);
+        }
+        // an exclusive L2 is filled by L1 victims only, a prefetch could duplicate a block of L1
+        if (prefetch[1] && inclusion == EXCLUSIVE) {
+            std::cerr << "An exclusive L2 can't prefetch!" << std::endl;
+            exit(1);
+        }
+        // the cycles come from the accesses of a serial run, and aren't saved in checkpoints
+        if (timing && (sharded || pipelined || sample_plan.period != 0 || !checkpoint.save_path.empty() ||
+            !checkpoint.restore_path.empty())) {
+            std::cerr << "Timing doesn't support -p, --pipeline, --sample or checkpoints!" << std::endl;
+            exit(1);
+        }
+        // the classifiers see every access of a serial run, and aren't saved in checkpoints
+        if (classify_misses && (sharded || pipelined || sample_plan.period != 0 || !checkpoint.save_path.empty() ||
+            !checkpoint.restore_path.empty())) {
+            std::cerr << "Miss classification doesn't support -p, --pipeline, --sample or checkpoints!" << std::endl;
+            exit(1);
+        }
+        if (!checkpoint.save_path.empty() && sample_plan.period != 0) {
+            std::cerr << "Save a checkpoint from a full run, sampled runs can restore one!" << std::endl;
+            exit(1);
+        }
+        if (sharded) {
+            ShardedSystem system(block_size, l1_size, l1_assoc, l2_size, l2_assoc, replacement, inclusion, threads);
+            system.run(trace_file);
+            system.print_results();
+            return 0;
+        }
+
         // Create the cache hierarchy
         auto l1 = std::make_shared<Cache>(l1_size, block_size, l1_assoc, replacement, inclusion);
+        l1->set_seed(seed);
+        std::shared_ptr<Cache> l2;
         if (l2_size != 0) {
-            auto l2 = std::make_shared<Cache>(l2_size, block_size, l2_assoc, replacement, inclusion);
-            l1->set_child(l2);
-            l2->set_parent(l1);
+            l2 = std::make_shared<Cache>(l2_size, block_size, l2_assoc, replacement, inclusion);
+            // L2 draws its own sequence
+            l2->set_seed(seed + 1);
+            // a pipelined L2 gets the L1 misses from its own stage
+            if (!pipelined) {
+                l1->set_child(l2);
+            }
+            l2->add_parent(l1);
+        }
+        if (prefetch[0]) {
+            l1->set_prefetcher(*prefetch[0]);
+        }
+        if (victim_entries != 0) {
+            l1->set_victim_cache(victim_entries);
+        }
+        if (write_buffer_entries != 0) {
+            l1->set_write_buffer(write_buffer_entries);
+        }
+        if (prefetch[1]) {
+            l2->set_prefetcher(*prefetch[1]);
+        }
+        if (classify_misses) {
+            l1->classify_misses();
+            if (l2 != nullptr) {
+                l2->classify_misses();
+            }
+        }
+        std::optional<TimingModel> timing_model;
+        if (timing) {
+            const LatencyTable &latencies = timing->latencies;
+            l1->set_latency(latencies.cache_latency(l1_size, l1_assoc), latencies.memory_latency());
+            if (l2 != nullptr) {
+                l2->set_latency(latencies.cache_latency(l2_size, l2_assoc), latencies.memory_latency());
+            }
+            timing_model.emplace(mshrs);
+        }
+        std::optional<Pipeline> pipeline;
+        if (pipelined) {
+            std::vector<std::shared_ptr<Cache>> chain{l1};
+            if (l2 != nullptr) {
+                chain.push_back(l2);
+            }
+            pipeline.emplace(chain);
         }
 
-        // Read the trace file, and start the simulation
-        std::ifstream infile(trace_file);
-        if (!infile.is_open()) {
-            std::cerr << "Invalid trace file!" << std::endl;
-            exit(1);
+        // a restored run goes on from where the saved one stopped
+        uint64_t start = 0;
+        if (!checkpoint.restore_path.empty()) {
+            start = restore_checkpoint(checkpoint.restore_path, *l1, l2.get());
         }
-        std::string line;
-        while (std::getline(infile, line)) {
-            std::istringstream iss(line);
-            char operation;
-            std::string address;
-            if (!(iss >> operation >> address)) { 
+
+        if (sample_plan.period != 0) {
+            run_sampled_cache(*l1, l2.get(), trace_file, sample_plan, start);
+            return 0;
+        }
+
+        // OPT looks ahead, so the trace is read once for the next use of every record
+        std::optional<NextUse> next_use;
+        if (replacement == OPTIMAL) {
+            next_use.emplace(block_size);
+            if (!next_use->build(trace_file)) {
                 std::cerr << "Invalid trace file!" << std::endl;
                 exit(1);
-                break;
             }
+            l1->set_next_use(&*next_use);
+        }
 
-            // std::cout << operation << " " << std::stoi(address, nullptr, 16) << std::endl;
-
-            if (operation == 'r') {
-                l1->read(address);
-            } else if (operation == 'w') {
-                l1->write(address);
-            } else {
-                std::cerr << "Invalid operation!" << std::endl;
+        // Read the trace file, and start the simulation
+        if (pipeline) {
+            pipeline->run(trace_file);
+        } else {
+            TraceReader reader(trace_file);
+            open_trace(reader, start);
+            uint64_t position = start;
+            std::vector<MemoryRecord> batch(TraceReader::kBatchSize);
+            while (size_t count = reader.read_memory(batch.data(), batch.size())) {
+                for (size_t i = 0; i < count; ++i) {
+                    const MemoryRecord &record = batch[i];
+                    int cycles;
+                    if (record.op == 'r') {
+                        cycles = l1->read(record.address);
+                    } else if (record.op == 'w') {
+                        cycles = l1->write(record.address);
+                    } else {
+                        std::cerr << "Invalid operation!" << std::endl;
+                        exit(1);
+                    }
+                    if (timing_model) {
+                        timing_model->access(cycles, l1->get_hit_latency());
+                    }
+                    if (++position == checkpoint.save_at && !checkpoint.save_path.empty()) {
+                        save_checkpoint(checkpoint.save_path, position, *l1, l2.get());
+                    }
+                }
+            }
+            if (reader.failed()) {
+                std::cerr << "Invalid trace file!" << std::endl;
+                exit(1);
+            }
+            if (!checkpoint.save_path.empty() && (checkpoint.save_at <= start || checkpoint.save_at > position)) {
+                std::cerr << "No record " << checkpoint.save_at << " to checkpoint after!" << std::endl;
                 exit(1);
             }
+            l1->drain_write_buffer();
         }
         l1->print_cache("L1 contents");
-        if (l2_size != 0) {
-            l1->get_child()->print_cache("L2 contents");
+        if (l2 != nullptr) {
+            l2->print_cache("L2 contents");
         }
 
         std::cout << "===== Simulation results (raw) =====" << std::endl;
         l1->print_summary("L1", 'a');
-        if (l2_size != 0) {
-            l1->get_child()->print_summary("L2", 'g');
-            l1->get_child()->print_traffic("L2", 'm');
+        if (l2 != nullptr) {
+            l2->print_summary("L2", 'g');
+            l2->print_traffic('m');
         } else {
             Cache tmp_l2 = Cache(0, 0, 0, replacement, inclusion);
             tmp_l2.print_summary("L2", 'g');
-            l1->print_traffic("L1", 'm');
+            l1->print_traffic('m');
+        }
+        if (prefetch[0] || prefetch[1]) {
+            std::cout << "===== Prefetch results =====" << std::endl;
+            char start_char = 'a';
+            if (l1->has_prefetcher()) {
+                l1->print_prefetch_summary("L1", start_char);
+                start_char += 6;
+            }
+            if (l2 != nullptr && l2->has_prefetcher()) {
+                l2->print_prefetch_summary("L2", start_char);
+            }
+        }
+        if (buffers) {
+            std::cout << "===== Victim cache and write buffer results =====" << std::endl;
+            l1->print_buffer_summary("L1", 'a');
+        }
+        if (timing_model) {
+            std::cout << "===== Timing results =====" << std::endl;
+            char start_char = l1->print_timing_summary("L1", 'a');
+            uint64_t memory_cycles = l1->get_timing_stats().memory_cycles;
+            if (l2 != nullptr) {
+                start_char = l2->print_timing_summary("L2", start_char);
+                memory_cycles += l2->get_timing_stats().memory_cycles;
+            }
+            timing_model->print_summary(timing->latencies.memory_latency(), memory_cycles, start_char);
+        }
+        if (classify_misses) {
+            std::cout << "===== Miss classification =====" << std::endl;
+            char start_char = l1->print_miss_classification("L1", 'a');
+            if (l2 != nullptr) {
+                l2->print_miss_classification("L2", start_char);
+            }
         }
     }
 
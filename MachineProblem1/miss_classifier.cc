@@ -0,0 +1,120 @@
+#include "miss_classifier.h"
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace {
+
+// the set of blocks seen starts with this many slots
+const uint64_t kInitialSeenSlots = 1 << 12;
+
+// Fibonacci hashing, the top bits of the product pick the slot of a table of 2^(64 - shift)
+uint64_t home_slot(uint64_t block, int shift) {
+    return (block * 0x9e3779b97f4a7c15ull) >> shift;
+}
+
+} // namespace
+
+MissClassifier::MissClassifier(int blocks)
+    : slots_(blocks, 0), prev_(blocks, kNone), next_(blocks, kNone), seen_(kInitialSeenSlots, kEmpty) {
+    uint32_t shadow_slots = std::bit_ceil(std::max(2 * uint32_t(blocks), 2u));
+    shadow_.assign(shadow_slots, ShadowSlot{kEmpty, kNone});
+    shadow_shift_ = 64 - std::countr_zero(shadow_slots);
+    seen_shift_ = 64 - std::countr_zero(kInitialSeenSlots);
+}
+
+uint32_t MissClassifier::find_shadow(uint64_t block) const {
+    uint32_t mask = shadow_.size() - 1;
+    for (uint32_t slot = home_slot(block, shadow_shift_);; slot = (slot + 1) & mask) {
+        if (shadow_[slot].block == block || shadow_[slot].block == kEmpty) {
+            return slot;
+        }
+    }
+}
+
+void MissClassifier::erase_shadow(uint32_t slot) {
+    uint32_t mask = shadow_.size() - 1;
+    for (uint32_t next = (slot + 1) & mask; shadow_[next].block != kEmpty; next = (next + 1) & mask) {
+        // a block whose home is not in (slot, next] was probed past slot, so it moves up into it
+        uint32_t home = home_slot(shadow_[next].block, shadow_shift_);
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            shadow_[slot] = shadow_[next];
+            slots_[shadow_[slot].entry] = slot;
+            slot = next;
+        }
+    }
+    shadow_[slot] = ShadowSlot{kEmpty, kNone};
+}
+
+bool MissClassifier::insert_seen(uint64_t block) {
+    uint64_t mask = seen_.size() - 1;
+    uint64_t slot = home_slot(block, seen_shift_);
+    for (; seen_[slot] != kEmpty; slot = (slot + 1) & mask) {
+        if (seen_[slot] == block) {
+            return false;
+        }
+    }
+    seen_[slot] = block;
+    if (2 * ++seen_count_ > seen_.size()) {
+        std::vector<uint64_t> old = std::move(seen_);
+        seen_.assign(old.size() * 2, kEmpty);
+        --seen_shift_;
+        mask = seen_.size() - 1;
+        for (uint64_t seen : old) {
+            if (seen == kEmpty) {
+                continue;
+            }
+            for (slot = home_slot(seen, seen_shift_); seen_[slot] != kEmpty; slot = (slot + 1) & mask) {
+            }
+            seen_[slot] = seen;
+        }
+    }
+    return true;
+}
+
+void MissClassifier::access(uint64_t block, bool missed) {
+    uint32_t slot = find_shadow(block);
+    bool shadow_hit = shadow_[slot].block == block;
+    // every block in the shadow has been seen, a prefetched one too before a demand access hits it
+    bool first = !shadow_hit && insert_seen(block);
+    if (missed) {
+        if (first) {
+            ++compulsory_;
+        } else if (!shadow_hit) {
+            ++capacity_;
+        } else {
+            ++conflict_;
+        }
+    }
+
+    uint32_t entry;
+    if (shadow_hit) {
+        entry = shadow_[slot].entry;
+        unlink(entry);
+    } else {
+        if (used_ < slots_.size()) {
+            entry = used_++;
+        } else {
+            // the shadow's LRU block makes room, which can move the slot of block
+            entry = tail_;
+            unlink(entry);
+            erase_shadow(slots_[entry]);
+            slot = find_shadow(block);
+        }
+        shadow_[slot] = ShadowSlot{block, entry};
+        slots_[entry] = slot;
+    }
+    push_front(entry);
+}
+
+void MissClassifier::unlink(uint32_t entry) {
+    (prev_[entry] == kNone ? head_ : next_[prev_[entry]]) = next_[entry];
+    (next_[entry] == kNone ? tail_ : prev_[next_[entry]]) = prev_[entry];
+}
+
+void MissClassifier::push_front(uint32_t entry) {
+    prev_[entry] = kNone;
+    next_[entry] = head_;
+    (head_ == kNone ? tail_ : prev_[head_]) = entry;
+    head_ = entry;
+}
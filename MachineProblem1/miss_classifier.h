@@ -0,0 +1,63 @@
+#ifndef MISS_CLASSIFIER_H
+#define MISS_CLASSIFIER_H
+
+#include <cstdint>
+#include <vector>
+
+// The 3C classification of the misses of a cache. A miss is compulsory on the first reference to
+// its block, capacity if a fully associative LRU cache of as many blocks misses too, and conflict
+// otherwise. The shadow cache is a list in recency order linked through arrays, found through an
+// open addressing table of its blocks, so an access is O(1) and the table stays as small as the
+// cache. Only a shadow miss looks at the set of blocks seen, and only growing that set allocates.
+class MissClassifier {
+public:
+    explicit MissClassifier(int blocks);
+
+    // every read and write of the cache, block is the address without its offset
+    void access(uint64_t block, bool missed);
+
+    uint64_t get_compulsory() const { return compulsory_; }
+    uint64_t get_capacity() const { return capacity_; }
+    uint64_t get_conflict() const { return conflict_; }
+
+private:
+    static constexpr uint32_t kNone = ~uint32_t(0);
+    static constexpr uint64_t kEmpty = ~uint64_t(0);
+
+    // the slot of block in the shadow table, or the empty slot it goes in
+    uint32_t find_shadow(uint64_t block) const;
+    // empty a slot of the shadow table, moving up the blocks probed past it
+    void erase_shadow(uint32_t slot);
+    // add block to the blocks seen, return false if it was there
+    bool insert_seen(uint64_t block);
+    void unlink(uint32_t entry);
+    // make entry the most recently used
+    void push_front(uint32_t entry);
+
+    // linear probing, at most half full: the block of a shadow entry (kEmpty in a free slot) and the entry
+    struct ShadowSlot {
+        uint64_t block;
+        uint32_t entry;
+    };
+    std::vector<ShadowSlot> shadow_;
+    int shadow_shift_;
+    // the table slot of each shadow entry, and the list from head_ (MRU) to tail_ (LRU)
+    std::vector<uint32_t> slots_;
+    std::vector<uint32_t> prev_;
+    std::vector<uint32_t> next_;
+    uint32_t head_ = kNone;
+    uint32_t tail_ = kNone;
+    // entries filled so far, the shadow evicts once all are
+    uint32_t used_ = 0;
+
+    // linear probing, doubled once half full, kEmpty in a free slot
+    std::vector<uint64_t> seen_;
+    int seen_shift_;
+    uint64_t seen_count_ = 0;
+
+    uint64_t compulsory_ = 0;
+    uint64_t capacity_ = 0;
+    uint64_t conflict_ = 0;
+};
+
+#endif // MISS_CLASSIFIER_H
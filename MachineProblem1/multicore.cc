@@ -0,0 +1,227 @@
+#include "multicore.h"
+#include <algorithm>
+#include <barrier>
+#include <format>
+#include <iostream>
+#include <thread>
+
+MulticoreSystem::MulticoreSystem(int cores, int block_size, int l1_size, int l1_assoc, int l2_size, int l2_assoc,
+    ReplacementPolicy replacement, InclusionPolicy inclusion, uint64_t seed, size_t quantum)
+    : cores_(cores), quantum_(quantum), pending_(cores), quanta_(cores), requests_(cores) {
+
+    // FIFO keeps matching invalidated blocks, OPT needs one trace, an exclusive L2 takes
+    // blocks away from a single L1
+    if (replacement != LRU && replacement != RANDOM) {
+        std::cerr << "Multicore runs support LRU and RANDOM replacement!" << std::endl;
+        exit(1);
+    }
+    if (inclusion == EXCLUSIVE) {
+        std::cerr << "Multicore runs support non-inclusive and inclusive L2s!" << std::endl;
+        exit(1);
+    }
+    l2_ = std::make_shared<Cache>(l2_size, block_size, l2_assoc, replacement, inclusion);
+    l2_->set_seed(seed + cores);
+    for (int c = 0; c < cores; c++) {
+        // the L1s reach the L2 through weave(), so they have no child
+        l1s_.push_back(std::make_shared<Cache>(l1_size, block_size, l1_assoc, replacement, inclusion));
+        l1s_.back()->set_seed(seed + c);
+        l2_->add_parent(l1s_.back());
+    }
+}
+
+bool MulticoreSystem::fill_quanta() {
+    bool any = false;
+    if (readers_.size() == 1) {
+        // deal the shared trace out until every core has a quantum, a core has read ahead its
+        // limit or the trace ends
+        TraceReader &reader = *readers_[0];
+        auto short_of_records = [&]() {
+            bool short_of = false;
+            for (const auto &pending : pending_) {
+                if (pending.size() >= kReadAheadQuanta * quantum_) {
+                    return false;
+                }
+                short_of = short_of || pending.size() < quantum_;
+            }
+            return short_of;
+        };
+        while (short_of_records()) {
+            size_t count = reader.read_memory(batch_.data(), batch_.size());
+            if (count == 0) {
+                break;
+            }
+            for (size_t i = 0; i < count; i++) {
+                if (batch_[i].core >= uint32_t(cores_)) {
+                    std::cerr << "Invalid core " << batch_[i].core << " in the trace!" << std::endl;
+                    exit(1);
+                }
+                pending_[batch_[i].core].push_back(batch_[i]);
+            }
+        }
+        for (int c = 0; c < cores_; c++) {
+            size_t count = std::min(quantum_, pending_[c].size());
+            quanta_[c].assign(pending_[c].begin(), pending_[c].begin() + count);
+            pending_[c].erase(pending_[c].begin(), pending_[c].begin() + count);
+        }
+    } else {
+        for (int c = 0; c < cores_; c++) {
+            quanta_[c].resize(quantum_);
+            quanta_[c].resize(readers_[c]->read_memory(quanta_[c].data(), quantum_));
+        }
+    }
+    for (int c = 0; c < cores_; c++) {
+        for (const MemoryRecord &record : quanta_[c]) {
+            if (record.op != 'r' && record.op != 'w') {
+                std::cerr << "Invalid operation!" << std::endl;
+                exit(1);
+            }
+        }
+        any = any || !quanta_[c].empty();
+    }
+    for (const auto &reader : readers_) {
+        if (reader->failed()) {
+            std::cerr << "Invalid trace file!" << std::endl;
+            exit(1);
+        }
+    }
+    return any;
+}
+
+void MulticoreSystem::bound(int core) {
+    Cache &l1 = *l1s_[core];
+    std::vector<BusRequest> &requests = requests_[core];
+    requests.clear();
+    for (size_t position = 0; position < quanta_[core].size(); position++) {
+        const MemoryRecord &record = quanta_[core][position];
+        MesiState state = l1.mesi_state(record.address);
+        if (record.op == 'r') {
+            l1.read(record.address);
+            if (state == MESI_INVALID) {
+                requests.push_back(BusRequest{uint32_t(position), BUS_READ, record.address, l1.get_last_victim()});
+            }
+        } else {
+            l1.write(record.address);
+            if (state == MESI_INVALID) {
+                requests.push_back(BusRequest{uint32_t(position), BUS_READ_EXCLUSIVE, record.address, l1.get_last_victim()});
+            } else if (state == MESI_SHARED) {
+                // S -> M needs the other copies gone, E -> M is silent
+                l1.set_shared(record.address, false);
+                requests.push_back(BusRequest{uint32_t(position), BUS_UPGRADE, record.address, CacheBlock()});
+            }
+        }
+    }
+}
+
+void MulticoreSystem::weave() {
+    std::vector<size_t> next(cores_, 0);
+    for (size_t position = 0; position < quantum_; position++) {
+        for (int core = 0; core < cores_; core++) {
+            if (next[core] == requests_[core].size() || requests_[core][next[core]].position != position) {
+                continue;
+            }
+            const BusRequest &request = requests_[core][next[core]++];
+            if (request.victim.valid && request.victim.dirty) {
+                l2_->write(request.victim.address);
+            }
+            bool shared = false;
+            bool supplied = false;
+            for (int other = 0; other < cores_; other++) {
+                if (other == core) {
+                    continue;
+                }
+                MesiState before = l1s_[other]->snoop(request.address, request.op == BUS_READ ? READ : INVALIDATE);
+                if (before == MESI_INVALID) {
+                    continue;
+                }
+                shared = true;
+                if (request.op != BUS_READ) {
+                    ++stats_.invalidations;
+                }
+                if (before == MESI_MODIFIED) {
+                    // the owner supplies the block and flushes it to the L2
+                    ++stats_.interventions;
+                    ++stats_.flushes;
+                    l2_->write(request.address);
+                    supplied = true;
+                }
+            }
+            if (request.op == BUS_UPGRADE) {
+                ++stats_.upgrades;
+                continue;
+            }
+            if (!supplied) {
+                l2_->read(request.address);
+            }
+            if (request.op == BUS_READ && shared) {
+                l1s_[core]->set_shared(request.address, true);
+            }
+        }
+    }
+}
+
+void MulticoreSystem::run(const std::vector<std::string> &trace_files, int threads) {
+    if (trace_files.size() != 1 && trace_files.size() != size_t(cores_)) {
+        std::cerr << "Give one trace per core, or one trace with a core column!" << std::endl;
+        exit(1);
+    }
+    for (const std::string &trace_file : trace_files) {
+        readers_.push_back(std::make_unique<TraceReader>(trace_file));
+        if (!readers_.back()->is_open()) {
+            std::cerr << "Invalid trace file!" << std::endl;
+            exit(1);
+        }
+    }
+    batch_.resize(TraceReader::kBatchSize);
+
+    // worker w runs the bound phase of cores w, w + workers, ...; the caller is worker 0
+    int workers = std::clamp(threads, 1, cores_);
+    bool done = false;
+    std::barrier sync(workers);
+    auto bound_cores = [&](int worker) {
+        for (int core = worker; core < cores_; core += workers) {
+            bound(core);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int w = 1; w < workers; w++) {
+        pool.emplace_back([&, w]() {
+            while (true) {
+                sync.arrive_and_wait();
+                if (done) {
+                    return;
+                }
+                bound_cores(w);
+                sync.arrive_and_wait();
+            }
+        });
+    }
+    while (true) {
+        done = !fill_quanta();
+        sync.arrive_and_wait();
+        if (done) {
+            break;
+        }
+        bound_cores(0);
+        sync.arrive_and_wait();
+        weave();
+    }
+    for (std::thread &worker : pool) {
+        worker.join();
+    }
+}
+
+void MulticoreSystem::print_results() {
+    std::cout << "===== Simulation results (raw) =====" << std::endl;
+    for (int c = 0; c < cores_; c++) {
+        std::cout << "===== Core " << c << " =====" << std::endl;
+        l1s_[c]->print_summary("L1", 'a');
+    }
+    std::cout << "===== Shared L2 =====" << std::endl;
+    l2_->print_summary("L2", 'a');
+    std::cout << "===== Coherence =====" << std::endl;
+    std::cout << "a. " << std::format("{:<27}", "number of invalidations:") << stats_.invalidations << std::endl;
+    std::cout << "b. " << std::format("{:<27}", "number of interventions:") << stats_.interventions << std::endl;
+    std::cout << "c. " << std::format("{:<27}", "number of upgrades:") << stats_.upgrades << std::endl;
+    std::cout << "d. " << std::format("{:<27}", "number of flushes:") << stats_.flushes << std::endl;
+    std::cout << "e. " << std::format("{:<27}", "total memory traffic: ") << l2_->get_memory_traffic() << std::endl;
+}
@@ -0,0 +1,85 @@
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "trace_reader.h"
+
+// coherence messages counted by a multicore run
+struct CoherenceStats {
+    // copies removed from other cores by a write miss or an upgrade
+    uint64_t invalidations = 0;
+    // a modified copy in another core supplies the block
+    uint64_t interventions = 0;
+    // a write hit to a shared block asks the other cores to drop their copies
+    uint64_t upgrades = 0;
+    // modified blocks written back to the shared cache by an intervention
+    uint64_t flushes = 0;
+};
+
+// N cores with private L1s kept coherent with snooping MESI in front of a shared L2.
+//
+// Cores run in quanta of quantum accesses. In the bound phase every core runs its next quantum on
+// its own L1 in parallel: hits complete there, and a miss or an upgrade fills or updates the L1 and
+// queues a bus request. In the weave phase the requests are granted in (position in the quantum,
+// core) order, snooping the other L1s and accessing the L2. The interleaving only depends on the
+// traces, so the counters are the same for any thread count. Within a quantum a core doesn't see
+// the other cores: a copy invalidated by another core (or by the inclusive L2) is still hit, and a
+// block another core also read is still written without an upgrade. A smaller quantum is more
+// exact and synchronises the threads more often, a quantum of 1 steps all cores one access at a time.
+class MulticoreSystem {
+public:
+    static constexpr size_t kDefaultQuantum = 256;
+    // a shared trace is read ahead until every core has a quantum or one core has this many
+    // quanta pending, so a core whose records stop early runs short quanta instead of the rest of
+    // the trace piling up in memory for the others
+    static constexpr size_t kReadAheadQuanta = 64;
+
+    MulticoreSystem(int cores, int block_size, int l1_size, int l1_assoc, int l2_size, int l2_assoc,
+        ReplacementPolicy replacement, InclusionPolicy inclusion, uint64_t seed, size_t quantum = kDefaultQuantum);
+    ~MulticoreSystem() = default;
+
+    // one trace per core, or a single trace whose records carry the core in their last column
+    void run(const std::vector<std::string> &trace_files, int threads);
+
+    void print_results();
+
+private:
+    enum BusOp {
+        BUS_READ,
+        BUS_READ_EXCLUSIVE,
+        BUS_UPGRADE,
+    };
+
+    struct BusRequest {
+        uint32_t position;
+        BusOp op;
+        uint64_t address;
+        // evicted by the fill, written back to the L2 if dirty
+        CacheBlock victim;
+    };
+
+    // top up every core's quantum from the traces, return false when all are empty
+    bool fill_quanta();
+    void bound(int core);
+    void weave();
+
+    int cores_;
+    size_t quantum_;
+    std::vector<std::shared_ptr<Cache>> l1s_;
+    std::shared_ptr<Cache> l2_;
+    CoherenceStats stats_;
+
+    std::vector<std::unique_ptr<TraceReader>> readers_;
+    std::vector<MemoryRecord> batch_;
+    // records read ahead from a shared trace for cores whose quantum was full
+    std::vector<std::deque<MemoryRecord>> pending_;
+    std::vector<std::vector<MemoryRecord>> quanta_;
+    std::vector<std::vector<BusRequest>> requests_;
+};
+
+#endif // MULTICORE_H
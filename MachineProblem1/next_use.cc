@@ -0,0 +1,43 @@
+#include "next_use.h"
+#include "trace_reader.h"
+#include <bit>
+#include <iostream>
+
+NextUse::NextUse(int block_size) {
+    if (!std::has_single_bit(unsigned(block_size))) {
+        std::cerr << "block_size must be a power of 2" << std::endl;
+        exit(1);
+    }
+    offset_bits_ = std::countr_zero(unsigned(block_size));
+}
+
+bool NextUse::build(const std::string &trace_file) {
+    TraceReader reader(trace_file);
+    if (!reader.is_open()) {
+        return false;
+    }
+    std::vector<MemoryRecord> batch(TraceReader::kBatchSize);
+    while (size_t count = reader.read_memory(batch.data(), batch.size())) {
+        for (size_t i = 0; i < count; ++i) {
+            add(batch[i].address);
+        }
+    }
+    // the simulation only looks forward from here
+    last_record_ = {};
+    return !reader.failed();
+}
+
+void NextUse::add(uint64_t address) {
+    if (next_.size() == kNever) {
+        std::cerr << "Trace is too long for OPT replacement!" << std::endl;
+        exit(1);
+    }
+    uint32_t record = next_.size();
+    next_.push_back(kNever);
+    // the previous record of this block now knows its next use, so one forward pass is enough
+    auto [it, inserted] = last_record_.try_emplace(address >> offset_bits_, record);
+    if (!inserted) {
+        next_[it->second] = record;
+        it->second = record;
+    }
+}
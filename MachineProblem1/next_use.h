@@ -0,0 +1,37 @@
+#ifndef NEXT_USE_H
+#define NEXT_USE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The future of a trace for Belady's OPT replacement: for every record, the index of the next
+// record that touches the same block. Built in one streaming pass before the simulation, so a
+// cache looks up when a block is needed again in O(1) instead of scanning the rest of the trace.
+class NextUse {
+public:
+    // a block that is never touched again
+    static constexpr uint32_t kNever = UINT32_MAX;
+
+    explicit NextUse(int block_size);
+    ~NextUse() = default;
+
+    // read the whole trace, return false if it can't be read
+    bool build(const std::string &trace_file);
+    // append one record, for building from records already in memory
+    void add(uint64_t address);
+
+    // next use of the block of record i
+    uint32_t operator[](size_t i) const { return next_[i]; }
+    size_t size() const { return next_.size(); }
+    int block_size() const { return 1 << offset_bits_; }
+
+private:
+    int offset_bits_;
+    std::vector<uint32_t> next_;
+    // block number -> index of its latest record, only needed while building
+    std::unordered_map<uint64_t, uint32_t> last_record_;
+};
+
+#endif // NEXT_USE_H
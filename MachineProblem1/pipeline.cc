@@ -0,0 +1,104 @@
+#include "pipeline.h"
+#include <iostream>
+
+Pipeline::Pipeline(const std::vector<std::shared_ptr<Cache>> &levels) : levels_(levels) {
+    for (size_t i = 0; i < levels_.size(); i++) {
+        if (levels_[i]->get_replacement() == OPTIMAL) {
+            std::cerr << "Pipelined runs don't support OPTIMAL replacement!" << std::endl;
+            exit(1);
+        }
+        if (i > 0 && levels_[i]->get_inclusion() != NON_INCLUSIVE) {
+            std::cerr << "Pipelined runs support non-inclusive lower levels!" << std::endl;
+            exit(1);
+        }
+        if (levels_[i]->get_child() != nullptr) {
+            std::cerr << "Pipelined levels must not have a child!" << std::endl;
+            exit(1);
+        }
+        rings_.push_back(std::make_unique<Ring>(kRingSize));
+    }
+}
+
+void Pipeline::decode(TraceReader &reader) {
+    Ring &out = *rings_[0];
+    RecordBatch *batch = &out.back();
+    while ((batch->count = reader.read_memory(batch->records, kBatchSize))) {
+        for (size_t i = 0; i < batch->count; i++) {
+            if (batch->records[i].op != 'r' && batch->records[i].op != 'w') {
+                std::cerr << "Invalid operation!" << std::endl;
+                exit(1);
+            }
+        }
+        out.push();
+        batch = &out.back();
+    }
+    if (reader.failed()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    out.close();
+}
+
+void Pipeline::run_level(size_t level) {
+    Cache &cache = *levels_[level];
+    Ring &in = *rings_[level];
+    Ring *out = level + 1 < levels_.size() ? rings_[level + 1].get() : nullptr;
+    RecordBatch *produced = nullptr;
+    auto emit = [&](char op, uint64_t address) {
+        if (produced == nullptr) {
+            produced = &out->back();
+            produced->count = 0;
+        }
+        produced->records[produced->count++] = MemoryRecord{op, 0, address};
+        if (produced->count == kBatchSize) {
+            out->push();
+            produced = nullptr;
+        }
+    };
+    while (RecordBatch *batch = in.front()) {
+        for (size_t i = 0; i < batch->count; i++) {
+            const MemoryRecord &record = batch->records[i];
+            if (record.op == 'r') {
+                cache.read(record.address);
+            } else {
+                cache.write(record.address);
+            }
+            if (out == nullptr || !cache.get_last_missed()) {
+                continue;
+            }
+            // the writeback of the victim, followed by the read, as Cache::access does
+            const CacheBlock &victim = cache.get_last_victim();
+            if (victim.valid && victim.dirty) {
+                emit('w', victim.address);
+            }
+            emit('r', record.address);
+        }
+        in.pop();
+        // pass a partial batch on rather than hold the next level back
+        if (produced != nullptr) {
+            out->push();
+            produced = nullptr;
+        }
+    }
+    if (out != nullptr) {
+        out->close();
+    }
+}
+
+void Pipeline::run(const std::string &trace_file) {
+    TraceReader reader(trace_file);
+    if (!reader.is_open()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    // one thread per stage, the caller runs the last level
+    std::vector<std::thread> stages;
+    stages.emplace_back([&]() { decode(reader); });
+    for (size_t level = 0; level + 1 < levels_.size(); level++) {
+        stages.emplace_back([this, level]() { run_level(level); });
+    }
+    run_level(levels_.size() - 1);
+    for (std::thread &stage : stages) {
+        stage.join();
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cache.h"
+#include "trace_reader.h"
+
+// Bounded lock-free queue between one producer thread and one consumer thread. Slots are filled
+// and drained in place, so a batch is never copied.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : slots_(capacity) {}
+
+    // producer: the slot to fill next, waits while the ring is full
+    T &back() {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        while (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+            std::this_thread::yield();
+        }
+        return slots_[tail % slots_.size()];
+    }
+    // producer: hand the slot returned by back() to the consumer
+    void push() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    // producer: nothing more will be pushed
+    void close() {
+        closed_.store(true, std::memory_order_release);
+    }
+
+    // consumer: the oldest pushed slot, waits while the ring is empty, nullptr once it is closed and empty
+    T *front() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        while (tail_.load(std::memory_order_acquire) == head) {
+            // every push happened before the close, so look at the tail once more
+            if (closed_.load(std::memory_order_acquire)) {
+                return tail_.load(std::memory_order_acquire) == head ? nullptr : &slots_[head % slots_.size()];
+            }
+            std::this_thread::yield();
+        }
+        return &slots_[head % slots_.size()];
+    }
+    // consumer: give the slot returned by front() back to the producer
+    void pop() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    // producer and consumer each write their own cache line
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    std::atomic<bool> closed_{false};
+    std::vector<T> slots_;
+};
+
+// A chain of caches run as a pipeline: one thread decodes the trace, and every level runs on its own
+// thread, reading batches of requests from the stage above and passing its writebacks and misses on
+// to the next level, in the order the serial run sends them to child_. Each level sees the same
+// requests in the same order as in the serial run, so the counters are identical.
+// Nothing may flow back up: every level below the first must be non-inclusive (inclusive and
+// exclusive levels reach into the level above), and OPTIMAL replacement is not supported (an L1
+// hit refreshes the next use in the L2).
+class Pipeline {
+public:
+    static constexpr size_t kBatchSize = 1024;
+    // batches in flight between two stages
+    static constexpr size_t kRingSize = 64;
+
+    // levels[0] serves the trace and levels[i + 1] serves levels[i]. The caches must not be linked
+    // with set_child, give the lower levels their parent with add_parent for print_summary
+    explicit Pipeline(const std::vector<std::shared_ptr<Cache>> &levels);
+
+    void run(const std::string &trace_file);
+
+private:
+    struct RecordBatch {
+        size_t count = 0;
+        MemoryRecord records[kBatchSize];
+    };
+    using Ring = SpscRing<RecordBatch>;
+
+    void decode(TraceReader &reader);
+    void run_level(size_t level);
+
+    std::vector<std::shared_ptr<Cache>> levels_;
+    // rings_[i] feeds levels_[i]
+    std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+#endif // PIPELINE_H
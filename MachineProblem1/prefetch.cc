@@ -0,0 +1,157 @@
+#include "prefetch.h"
+#include <algorithm>
+#include <format>
+#include <sstream>
+
+bool parse_prefetch_config(const std::string &spec, PrefetchConfig &config) {
+    std::istringstream iss(spec);
+    std::string kind;
+    if (!std::getline(iss, kind, ',')) {
+        return false;
+    }
+    std::vector<int> fields;
+    std::string field;
+    while (std::getline(iss, field, ',')) {
+        try {
+            size_t used;
+            fields.push_back(std::stoi(field, &used));
+            if (used != field.size()) {
+                return false;
+            }
+        } catch (std::exception const &) {
+            return false;
+        }
+    }
+    // the fields of the kind, then the optional latency
+    size_t count;
+    if (kind == "next") {
+        config.kind = NEXT_LINE;
+        count = 1;
+    } else if (kind == "stride") {
+        config.kind = STRIDE;
+        count = 2;
+    } else if (kind == "stream") {
+        config.kind = STREAM;
+        count = 2;
+    } else {
+        return false;
+    }
+    if (fields.size() != count && fields.size() != count + 1) {
+        return false;
+    }
+    config.latency = fields.size() > count ? fields[count] : 0;
+    if (config.kind == NEXT_LINE) {
+        config.degree = fields[0];
+        return config.degree > 0 && config.latency >= 0;
+    } else if (config.kind == STRIDE) {
+        config.entries = fields[0];
+        config.degree = fields[1];
+        return config.entries > 0 && config.degree > 0 && config.latency >= 0;
+    }
+    config.entries = fields[0];
+    config.depth = fields[1];
+    return config.entries > 0 && config.depth > 0 && config.latency >= 0;
+}
+
+std::string describe_prefetch_config(const PrefetchConfig &config) {
+    std::string text;
+    if (config.kind == NEXT_LINE) {
+        text = std::format("next,{}", config.degree);
+    } else if (config.kind == STRIDE) {
+        text = std::format("stride,{},{}", config.entries, config.degree);
+    } else {
+        text = std::format("stream,{},{}", config.entries, config.depth);
+    }
+    return config.latency == 0 ? text : text + std::format(",{}", config.latency);
+}
+
+std::unique_ptr<Prefetcher> make_prefetcher(const PrefetchConfig &config, int offset_bits) {
+    if (config.kind == NEXT_LINE) {
+        return std::make_unique<NextLinePrefetcher>(config.degree);
+    } else if (config.kind == STRIDE) {
+        return std::make_unique<StridePrefetcher>(config.entries, config.degree, std::max(0, 12 - offset_bits));
+    }
+    return std::make_unique<StreamPrefetcher>(config.entries, config.depth);
+}
+
+void NextLinePrefetcher::access(uint64_t block, bool miss, bool prefetch_hit, std::vector<uint64_t> &prefetches) {
+    if (!miss && !prefetch_hit) {
+        return;
+    }
+    for (int i = 1; i <= degree_; i++) {
+        prefetches.push_back(block + i);
+    }
+}
+
+StridePrefetcher::StridePrefetcher(int entries, int degree, int region_bits)
+    : table_(entries), degree_(degree), region_bits_(region_bits) {
+}
+
+void StridePrefetcher::access(uint64_t block, bool, bool, std::vector<uint64_t> &prefetches) {
+    uint64_t region = block >> region_bits_;
+    Entry &entry = table_[region % table_.size()];
+    if (!entry.valid || entry.region != region) {
+        entry = Entry{region, true, block, 0, 0};
+        return;
+    }
+    int64_t stride = int64_t(block - entry.last_block);
+    if (stride == 0) {
+        return;
+    }
+    if (stride == entry.stride) {
+        entry.confidence = std::min(entry.confidence + 1, 3);
+    } else if (--entry.confidence <= 0) {
+        entry.stride = stride;
+        entry.confidence = 0;
+    }
+    entry.last_block = block;
+    if (entry.confidence >= 2) {
+        for (int i = 1; i <= degree_; i++) {
+            prefetches.push_back(block + entry.stride * i);
+        }
+    }
+}
+
+StreamPrefetcher::StreamPrefetcher(int streams, int depth) : streams_(streams), depth_(depth) {
+}
+
+int StreamPrefetcher::find_stream(uint64_t block) const {
+    for (size_t i = 0; i < streams_.size(); i++) {
+        const Stream &stream = streams_[i];
+        if (!stream.valid) {
+            continue;
+        }
+        if (stream.direction > 0 ? (block < stream.front && stream.front - block <= uint64_t(depth_))
+                                 : (block > stream.front && block - stream.front <= uint64_t(depth_))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void StreamPrefetcher::access(uint64_t block, bool miss, bool, std::vector<uint64_t> &prefetches) {
+    ++clock_;
+    int i = find_stream(block);
+    if (i == -1) {
+        if (!miss) {
+            return;
+        }
+        // a new stream replaces the least recently used one
+        i = std::min_element(streams_.begin(), streams_.end(), [](const Stream &a, const Stream &b) {
+            return a.valid < b.valid || (a.valid == b.valid && a.last_use < b.last_use);
+        }) - streams_.begin();
+        // nothing is below block 0, a stream from there ascends
+        int direction = block != 0 && block + 1 == last_miss_ ? -1 : 1;
+        streams_[i] = Stream{true, block + direction, direction, clock_};
+    }
+    if (miss) {
+        last_miss_ = block;
+    }
+    // stay depth blocks ahead of block
+    Stream &stream = streams_[i];
+    stream.last_use = clock_;
+    while (stream.direction > 0 ? stream.front <= block + depth_ : (stream.front + depth_ >= block && stream.front != 0)) {
+        prefetches.push_back(stream.front);
+        stream.front += stream.direction;
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum PrefetcherKind {
+    NEXT_LINE,
+    STRIDE,
+    STREAM,
+};
+
+// a prefetcher attached to one cache level
+struct PrefetchConfig {
+    PrefetcherKind kind = NEXT_LINE;
+    // NEXT_LINE: blocks ahead, STRIDE: strides ahead
+    int degree = 1;
+    // STRIDE: entries of the region table, STREAM: streams tracked
+    int entries = 0;
+    // STREAM: blocks a stream runs ahead of the accesses
+    int depth = 0;
+    // accesses to the cache before a prefetched block arrives, a demand hit sooner is late
+    int latency = 0;
+};
+
+// "next,<N>[,<latency>]", "stride,<entries>,<degree>[,<latency>]" or
+// "stream,<streams>,<depth>[,<latency>]". Return false if the spec is invalid
+bool parse_prefetch_config(const std::string &spec, PrefetchConfig &config);
+// the spec of config, for printing the configuration
+std::string describe_prefetch_config(const PrefetchConfig &config);
+
+// Watches the demand accesses of a cache and picks blocks to prefetch. Blocks are addresses
+// without their block offset.
+class Prefetcher {
+public:
+    virtual ~Prefetcher() = default;
+
+    // block was accessed, missed or hit a block a prefetch brought in (its first use).
+    // Append the blocks to prefetch to prefetches, the cache skips the ones it already holds
+    virtual void access(uint64_t block, bool miss, bool prefetch_hit, std::vector<uint64_t> &prefetches) = 0;
+};
+
+// offset_bits of the cache, a STRIDE region is a 4 KiB page
+std::unique_ptr<Prefetcher> make_prefetcher(const PrefetchConfig &config, int offset_bits);
+
+// next-N-line (tagged): a miss, or the first use of a prefetched block, fetches the next N blocks
+class NextLinePrefetcher : public Prefetcher {
+public:
+    explicit NextLinePrefetcher(int degree) : degree_(degree) {}
+
+    void access(uint64_t block, bool miss, bool prefetch_hit, std::vector<uint64_t> &prefetches) override;
+
+private:
+    int degree_;
+};
+
+// Stride detection without PCs: a direct mapped table of regions, each with the last block
+// touched in it, the last stride and a 2 bit confidence. Two equal strides in a row and the
+// next degree blocks of the stride are prefetched.
+class StridePrefetcher : public Prefetcher {
+public:
+    StridePrefetcher(int entries, int degree, int region_bits);
+
+    void access(uint64_t block, bool miss, bool prefetch_hit, std::vector<uint64_t> &prefetches) override;
+
+private:
+    struct Entry {
+        uint64_t region = 0;
+        bool valid = false;
+        uint64_t last_block = 0;
+        int64_t stride = 0;
+        int confidence = 0;
+    };
+
+    std::vector<Entry> table_;
+    int degree_;
+    // blocks per region as a power of 2
+    int region_bits_;
+};
+
+// Stream buffers: a miss outside every stream starts one (LRU among streams), ascending or,
+// if the miss is just below the previous one, descending. The stream fetches depth blocks
+// ahead, and every access inside its window moves the window on to stay depth ahead.
+class StreamPrefetcher : public Prefetcher {
+public:
+    StreamPrefetcher(int streams, int depth);
+
+    void access(uint64_t block, bool miss, bool prefetch_hit, std::vector<uint64_t> &prefetches) override;
+
+private:
+    struct Stream {
+        bool valid = false;
+        // the next block to prefetch
+        uint64_t front = 0;
+        int direction = 1;
+        uint64_t last_use = 0;
+    };
+
+    // the stream whose window [front - depth, front) (or its descending mirror) holds block
+    int find_stream(uint64_t block) const;
+
+    std::vector<Stream> streams_;
+    int depth_;
+    uint64_t clock_ = 0;
+    uint64_t last_miss_ = 0;
+};
+
+#endif // PREFETCH_H
@@ -1,179 +1,481 @@
 #include "set.h"
+#include "checkpoint.h"
+#include "tag_match.h"
+#include <algorithm>
+#include <bit>
+#include <utility>
 
-Set::Set(int associativity, ReplacementPolicy replace, InclusionPolicy inclusion) 
-    : associativity_(associativity), replace_(replace), inclusion_(inclusion),first_(0), last_(0), count_(0) {
+namespace {
 
-    
-    blocks_ = std::vector<CacheBlock>(associativity_, CacheBlock());
-    if (replace_ == LRU) {
-        lru_matrix_ = std::vector<std::vector<bool>>(associativity_, std::vector<bool>(associativity_, false));
-    }
+// the RRIP prediction of a block not expected back soon, the first to go
+const int kRripDistant = 3;
+// BRRIP inserts one block in this many with the long prediction of SRRIP, the rest distant
+const int kBimodalThrottle = 32;
+// the DRRIP policy selection counter is 10 bits, followers use BRRIP above half
+const int kPselMax = 1023;
+
+} // namespace
+
+void XorShift64::seed(uint64_t seed) {
+    // splitmix64 spreads small seeds over the state, which must not be 0
+    uint64_t z = seed + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    state = (z ^ (z >> 31)) | 1;
+}
+
+uint64_t XorShift64::next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dull;
+}
+
+int XorShift64::below(int n) {
+    return int((unsigned __int128)next() * unsigned(n) >> 64);
+}
+
+Set::Set(const SetArrays &arrays, int index)
+    : arrays_(arrays), index_(index), way_(size_t(index) * arrays.associativity),
+    word_(size_t(index) * arrays.words_per_set), state_(arrays.states[index]) {
 }
 
 
 int Set::fifo_hit_index(const CacheBlock &block) {
-    for (int i = 0; i < associativity_; ++i) {
-        if (block.tag == blocks_[i].tag) {
-            return i;
-        }
-    }
-    return -1;
+    // only the first count blocks have ever been filled, invalidated ones still match
+    return find_tag(ways(arrays_.tags), arrays_.all_ways, state_.count, block.tag);
 }
 
 int Set::fifo_empty_index() {
-    if (count_ != associativity_) {
-        return last_;
+    if (state_.count != arrays_.associativity) {
+        return state_.last;
     }
     return -1;
 }
 
 // return `if hit`, if hit return true, if miss return false
-bool Set::lru_access(const CacheBlock &block, std::string &viticm_hex, Mode mode, bool &set_dirty, bool &victim_dirty, int &writeback_memory) {
+bool Set::access(const CacheBlock &block, CacheBlock &victim, Mode mode, bool &set_dirty, uint64_t &writeback_memory) {
     // for debug
     set_dirty = false;
-    victim_dirty = false;
-    if (mode == INVALIDATE && -1 == lru_hit_index(block)) { // invalidate miss, do nothing
+    victim = CacheBlock();
+    int hit_index = lru_hit_index(block);
+    if (mode == INVALIDATE && -1 == hit_index) { // invalidate miss, do nothing
         return true;
     }
-    if (-1 != lru_hit_index(block)) {  // hit
-        int hit_index = lru_hit_index(block);
-        set_row_unset_column(hit_index);
+    if (-1 != hit_index) {  // hit
+        if (mode != INVALIDATE) {
+            use_prefetched(hit_index);
+        }
+        touch(hit_index, block, false);
         if (mode == WRITE) {
-            blocks_[hit_index] = block; // stupid mistake
-            blocks_[hit_index].dirty = true;
+            put(hit_index, block); // stupid mistake
+            set_dirty_bit(hit_index);
             set_dirty = true;
         } else if (mode == INVALIDATE) {
-            if (blocks_[hit_index].dirty) {
+            if (is_dirty(hit_index)) {
                 ++writeback_memory; // L1 block to be invalidated is dirty, write to main memory directly.
             }
-            blocks_[hit_index].valid = false;
+            clear_valid_bit(hit_index);
         }
         return true;
-    } else if (-1 != lru_empty_index()) { // not full, push
-
-        const int empty_index = lru_empty_index();
-        blocks_[empty_index] = block;
-        set_row_unset_column(empty_index);
-
-        if (mode == WRITE) {
-            blocks_[empty_index].dirty = true;
-            set_dirty = true;
-        }
-
-    } else { // full
-    
-        int victim_index = all_0_row();
-        set_row_unset_column(victim_index);
-        viticm_hex = blocks_[victim_index].address_hex;
-        victim_dirty = blocks_[victim_index].dirty;
-        blocks_[victim_index] = block;
-
-        if (mode == WRITE) {
-            blocks_[victim_index].dirty = true;
-            set_dirty = true;
-        }
     }
 
+    duel_miss();
+    int fill_index = fill(block, victim);
+    if (mode == WRITE) {
+        set_dirty_bit(fill_index);
+        set_dirty = true;
+    }
     return false;
 }
 
 // return hit, if hit return true, if miss return false
-bool Set::fifo_access(const CacheBlock &block, std::string &viticm_hex, Mode mode, bool &set_dirty, bool &victim_dirty, int &writeback_memory) {
+bool Set::fifo_access(const CacheBlock &block, CacheBlock &victim, Mode mode, bool &set_dirty, uint64_t &writeback_memory) {
     // for debug
     set_dirty = false;
-    victim_dirty = false;
+    victim = CacheBlock();
     int hit_index = fifo_hit_index(block);
     if (mode == INVALIDATE && -1 == hit_index) { // invalidate miss, do nothing
         return true;
     }
     if (-1 != hit_index) { // hit
+        if (mode != INVALIDATE) {
+            use_prefetched(hit_index);
+        }
         if (mode == WRITE) {
-            blocks_[hit_index].dirty = true;
+            set_dirty_bit(hit_index);
             set_dirty = true;
         } else if (mode == INVALIDATE) {
-            if (blocks_[hit_index].dirty) {
+            if (is_dirty(hit_index)) {
                 ++writeback_memory; // L1 block to be invalidated is dirty, write to main memory directly.
             }
-            blocks_[hit_index].valid = false;
+            clear_valid_bit(hit_index);
         }
         return true;
+    }
 
-    } else if (-1 != fifo_empty_index()) { // miss, not full, push
-        const int empty_index = fifo_empty_index();
-        blocks_[empty_index] = block;
-        if (mode == WRITE) {
-            blocks_[empty_index].dirty = true;
-            set_dirty = true;
+    int fill_index = fifo_fill(block, victim);
+    if (mode == WRITE) {
+        set_dirty_bit(fill_index);
+        set_dirty = true;
+    }
+    return false;
+}
+
+int Set::fill(const CacheBlock &block, CacheBlock &victim) {
+    int fill_index = lru_empty_index();
+    if (-1 == fill_index) { // full
+        fill_index = choose_victim();
+        victim = (*this)[fill_index];
+    }
+    put(fill_index, block);
+    touch(fill_index, block, true);
+    return fill_index;
+}
+
+int Set::fifo_fill(const CacheBlock &block, CacheBlock &victim) {
+    int fill_index = fifo_empty_index();
+    if (-1 != fill_index) { // not full, push
+        ++state_.last;
+        ++state_.count;
+    } else { // full, fifo
+        fill_index = state_.last % arrays_.associativity;
+        // an invalidated block still occupies its FIFO slot, so it is evicted like any other
+        victim = (*this)[state_.first];
+        victim.valid = true;
+        state_.first = (state_.first + 1) % arrays_.associativity;
+        state_.last = (state_.last + 1) % arrays_.associativity;
+    }
+    put(fill_index, block);
+    return fill_index;
+}
+
+bool Set::insert(const CacheBlock &block, CacheBlock &victim) {
+    victim = CacheBlock();
+    if (arrays_.replacement == FIFO) {
+        // a block taken by the level above leaves a hole in the FIFO, which is not a victim
+        bool hole = -1 == fifo_empty_index() && !(*this)[state_.first].valid;
+        fifo_fill(block, victim);
+        if (hole) {
+            victim = CacheBlock();
         }
-        // update fifo pointers
-        ++last_;
-        ++count_;
-    } else { // miss, full, fifo
-        int victim_index = first_;
-        int push_index = last_ % associativity_;
-
-        viticm_hex = blocks_[victim_index].address_hex;
-        victim_dirty = blocks_[victim_index].dirty;
-        blocks_[push_index] = block;
-        if (mode == WRITE) {
-            blocks_[push_index].dirty = true;
-            set_dirty = true;
+    } else {
+        fill(block, victim);
+    }
+    return victim.valid;
+}
+
+bool Set::remove(const CacheBlock &block, bool &dirty) {
+    int hit_index = lru_hit_index(block);
+    if (-1 == hit_index) {
+        return false;
+    }
+    dirty = is_dirty(hit_index);
+    use_prefetched(hit_index);
+    clear_valid_bit(hit_index);
+    return true;
+}
+
+bool Set::prefetch(const CacheBlock &block, CacheBlock &victim) {
+    victim = CacheBlock();
+    int fill_index;
+    if (arrays_.replacement == FIFO) {
+        if (-1 != fifo_hit_index(block)) {
+            return false;
         }
+        fill_index = fifo_fill(block, victim);
+    } else {
+        if (-1 != lru_hit_index(block)) {
+            return false;
+        }
+        fill_index = fill(block, victim);
+    }
+    PrefetchStats &stats = *arrays_.prefetch_stats;
+    ++stats.issued;
+    words(arrays_.prefetched)[fill_index / 64] |= uint64_t(1) << (fill_index % 64);
+    ways(arrays_.prefetch_times)[fill_index] = stats.clock;
+    return true;
+}
 
-        // update fifo pointers
-        first_ = (first_ + 1) % associativity_;
-        last_ = (last_ + 1) % associativity_;
+void Set::use_prefetched(int i) {
+    if (arrays_.prefetched == nullptr || !((words(arrays_.prefetched)[i / 64] >> (i % 64)) & 1)) {
+        return;
+    }
+    words(arrays_.prefetched)[i / 64] &= ~(uint64_t(1) << (i % 64));
+    PrefetchStats &stats = *arrays_.prefetch_stats;
+    ++stats.useful;
+    if (stats.clock - ways(arrays_.prefetch_times)[i] < uint64_t(stats.latency)) {
+        ++stats.late;
     }
+}
 
-    return false;
+void Set::drop_prefetched(int i) {
+    if (arrays_.prefetched == nullptr || !((words(arrays_.prefetched)[i / 64] >> (i % 64)) & 1)) {
+        return;
+    }
+    words(arrays_.prefetched)[i / 64] &= ~(uint64_t(1) << (i % 64));
+    ++arrays_.prefetch_stats->useless;
 }
 
-// if hit, update the lru matrix
-int Set::lru_hit_index(const CacheBlock &block) {
-    for (int i = 0; i < associativity_; i++) {
-        if (blocks_[i].valid && blocks_[i].tag == block.tag) {
-            return i;
-        }
+void Set::mark_dirty(const CacheBlock &block) {
+    int hit_index = arrays_.replacement == FIFO ? fifo_hit_index(block) : lru_hit_index(block);
+    if (-1 != hit_index) {
+        set_dirty_bit(hit_index);
     }
-    return -1;
+}
+
+MesiState Set::state(const CacheBlock &block) {
+    int hit_index = lru_hit_index(block);
+    if (-1 == hit_index) {
+        return MESI_INVALID;
+    } else if (is_dirty(hit_index)) {
+        return MESI_MODIFIED;
+    }
+    return ((words(arrays_.shared)[hit_index / 64] >> (hit_index % 64)) & 1) ? MESI_SHARED : MESI_EXCLUSIVE;
+}
+
+MesiState Set::snoop(const CacheBlock &block, Mode mode) {
+    MesiState before = state(block);
+    if (before == MESI_INVALID) {
+        return before;
+    }
+    int hit_index = lru_hit_index(block);
+    uint64_t bit = uint64_t(1) << (hit_index % 64);
+    if (mode == INVALIDATE) {
+        clear_valid_bit(hit_index);
+    } else {
+        // a modified block is flushed by the caller
+        words(arrays_.dirty)[hit_index / 64] &= ~bit;
+        words(arrays_.shared)[hit_index / 64] |= bit;
+    }
+    return before;
+}
+
+void Set::set_shared(const CacheBlock &block, bool shared) {
+    int hit_index = lru_hit_index(block);
+    if (-1 != hit_index) {
+        uint64_t bit = uint64_t(1) << (hit_index % 64);
+        words(arrays_.shared)[hit_index / 64] = shared ? (words(arrays_.shared)[hit_index / 64] | bit) : (words(arrays_.shared)[hit_index / 64] & ~bit);
+    }
+}
+
+int Set::lru_hit_index(const CacheBlock &block) {
+    return find_tag(ways(arrays_.tags), words(arrays_.valid), arrays_.associativity, block.tag);
 }
 
 // return empty index
 int Set::lru_empty_index() {
-    for (int i = 0; i < associativity_; i++) {
-        if (!blocks_[i].valid) {
-            return i;
+    for (int base = 0; base < arrays_.associativity; base += 64) {
+        uint64_t empty = ~words(arrays_.valid)[base / 64] & arrays_.all_ways[base / 64];
+        if (empty != 0) {
+            return base + std::countr_zero(empty);
         }
     }
     return -1;
 }
 
-void Set::set_row_unset_column(int i) {
-     for (int j = 0; j < associativity_; j++) {
-        // set the row
-        lru_matrix_[i][j] = true;
-        // unset the column
-        lru_matrix_[j][i] = false;
+void Set::touch(int i, const CacheBlock &block, bool filled) {
+    if (arrays_.replacement == LRU) {
+        lru_touch(i);
+    } else if (arrays_.replacement == OPTIMAL) {
+        opt_update(i, block.next_use);
+    } else if (arrays_.replacement == PLRU) {
+        plru_touch(i);
+    } else if (is_rrip(arrays_.replacement)) {
+        // a hit predicts the block is re-referenced soon
+        rrip_set(i, filled ? rrip_insertion() : 0);
     }
 }
 
-int Set::all_0_row() {
-    for (int i = 0; i < associativity_; i++) {
-        bool all_0 = true;
-        for (int j = 0; j < associativity_; j++) {
-            if (lru_matrix_[i][j]) {
-                all_0 = false;
-                break;
+int Set::choose_victim() {
+    if (arrays_.replacement == RANDOM) {
+        return arrays_.rng->below(arrays_.associativity);
+    } else if (arrays_.replacement == OPTIMAL) {
+        // the block needed furthest in the future
+        return ways(arrays_.opt_heap)[0];
+    } else if (arrays_.replacement == PLRU) {
+        return plru_victim_index();
+    } else if (is_rrip(arrays_.replacement)) {
+        return rrip_victim_index();
+    }
+    return lru_victim_index();
+}
+
+void Set::refresh_next_use(const CacheBlock &block) {
+    int hit_index = lru_hit_index(block);
+    if (-1 != hit_index) {
+        opt_update(hit_index, block.next_use);
+    }
+}
+
+void Set::lru_touch(int i) {
+    ways(arrays_.lru_stamps)[i] = ++state_.lru_clock;
+}
+
+int Set::lru_victim_index() {
+    int victim = 0;
+    for (int i = 1; i < arrays_.associativity; i++) {
+        if (ways(arrays_.lru_stamps)[i] < ways(arrays_.lru_stamps)[victim]) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+void Set::opt_update(int i, uint32_t next_use) {
+    uint32_t *keys = ways(arrays_.next_uses);
+    int *heap = ways(arrays_.opt_heap);
+    keys[i] = next_use;
+    int slot = ways(arrays_.opt_slot)[i];
+    // sift up
+    while (slot > 0 && keys[heap[(slot - 1) / 2]] < keys[heap[slot]]) {
+        opt_swap(slot, (slot - 1) / 2);
+        slot = (slot - 1) / 2;
+    }
+    // sift down
+    while (true) {
+        int largest = slot;
+        for (int child = 2 * slot + 1; child <= 2 * slot + 2 && child < arrays_.associativity; child++) {
+            if (keys[heap[child]] > keys[heap[largest]]) {
+                largest = child;
             }
         }
-        if (all_0) {
-            return i;
+        if (largest == slot) {
+            break;
+        }
+        opt_swap(slot, largest);
+        slot = largest;
+    }
+}
+
+void Set::opt_swap(int a, int b) {
+    int *heap = ways(arrays_.opt_heap);
+    int *slots = ways(arrays_.opt_slot);
+    std::swap(heap[a], heap[b]);
+    slots[heap[a]] = a;
+    slots[heap[b]] = b;
+}
+
+void Set::rrip_set(int i, int prediction) {
+    uint64_t bit = uint64_t(1) << (i % 64);
+    words(arrays_.rrip_low)[i / 64] = (prediction & 1) ? (words(arrays_.rrip_low)[i / 64] | bit) : (words(arrays_.rrip_low)[i / 64] & ~bit);
+    words(arrays_.rrip_high)[i / 64] = (prediction & 2) ? (words(arrays_.rrip_high)[i / 64] | bit) : (words(arrays_.rrip_high)[i / 64] & ~bit);
+}
+
+DuelRole Set::duel() const {
+    if (arrays_.leader_spacing == 0) {
+        return DUEL_FOLLOWER;
+    }
+    int offset = index_ % arrays_.leader_spacing;
+    return offset == 0 ? DUEL_SRRIP : offset == 1 ? DUEL_BRRIP : DUEL_FOLLOWER;
+}
+
+void Set::duel_miss() {
+    if (arrays_.replacement != DRRIP) {
+        return;
+    }
+    int &psel = *arrays_.psel;
+    DuelRole role = duel();
+    if (role == DUEL_SRRIP) {
+        psel = std::min(psel + 1, kPselMax);
+    } else if (role == DUEL_BRRIP) {
+        psel = std::max(psel - 1, 0);
+    }
+}
+
+int Set::rrip_insertion() {
+    ReplacementPolicy policy = arrays_.replacement;
+    if (policy == DRRIP) {
+        DuelRole role = duel();
+        if (role == DUEL_SRRIP) {
+            policy = SRRIP;
+        } else if (role == DUEL_BRRIP) {
+            policy = BRRIP;
+        } else {
+            policy = *arrays_.psel > kPselMax / 2 ? BRRIP : SRRIP;
+        }
+    }
+    // a block of a scan mostly comes in distant and leaves first, without pushing the others out
+    if (policy == BRRIP && arrays_.rng->below(kBimodalThrottle) != 0) {
+        return kRripDistant;
+    }
+    return kRripDistant - 1;
+}
+
+int Set::rrip_victim_index() {
+    uint64_t *low = words(arrays_.rrip_low);
+    uint64_t *high = words(arrays_.rrip_high);
+    while (true) {
+        for (int w = 0; w < arrays_.words_per_set; w++) {
+            uint64_t distant = low[w] & high[w] & arrays_.all_ways[w];
+            if (distant != 0) {
+                return w * 64 + std::countr_zero(distant);
+            }
+        }
+        // no way is at 3, so adding 1 to every prediction carries nothing out of its 2 bits
+        for (int w = 0; w < arrays_.words_per_set; w++) {
+            high[w] ^= low[w];
+            low[w] = ~low[w] & arrays_.all_ways[w];
         }
     }
-    return -1;
 }
 
+void Set::plru_touch(int i) {
+    uint64_t *bits = words(arrays_.plru_bits);
+    int node = 1;
+    for (int level = std::countr_zero(unsigned(arrays_.associativity)) - 1; level >= 0; level--) {
+        int right = (i >> level) & 1;
+        uint64_t bit = uint64_t(1) << (node % 64);
+        bits[node / 64] = right ? (bits[node / 64] & ~bit) : (bits[node / 64] | bit);
+        node = 2 * node + right;
+    }
+}
 
-CacheBlock& Set::operator[](int index) {
-    return blocks_[index];
-}
\ No newline at end of file
+int Set::plru_victim_index() const {
+    int node = 1;
+    while (node < arrays_.associativity) {
+        node = 2 * node + int((words(arrays_.plru_bits)[node / 64] >> (node % 64)) & 1);
+    }
+    return node - arrays_.associativity;
+}
+
+void Set::put(int i, const CacheBlock &block) {
+    uint64_t bit = uint64_t(1) << (i % 64);
+    drop_prefetched(i);
+    ways(arrays_.tags)[i] = block.tag;
+    ways(arrays_.addresses)[i] = block.address;
+    words(arrays_.valid)[i / 64] = block.valid ? (words(arrays_.valid)[i / 64] | bit) : (words(arrays_.valid)[i / 64] & ~bit);
+    words(arrays_.dirty)[i / 64] = block.dirty ? (words(arrays_.dirty)[i / 64] | bit) : (words(arrays_.dirty)[i / 64] & ~bit);
+    words(arrays_.shared)[i / 64] &= ~bit;
+}
+
+bool Set::is_dirty(int i) const {
+    return (words(arrays_.dirty)[i / 64] >> (i % 64)) & 1;
+}
+
+void Set::set_dirty_bit(int i) {
+    words(arrays_.dirty)[i / 64] |= uint64_t(1) << (i % 64);
+}
+
+void Set::clear_valid_bit(int i) {
+    drop_prefetched(i);
+    words(arrays_.valid)[i / 64] &= ~(uint64_t(1) << (i % 64));
+}
+
+CacheBlock Set::operator[](int index) const {
+    return CacheBlock{ways(arrays_.tags)[index], bool((words(arrays_.valid)[index / 64] >> (index % 64)) & 1),
+        is_dirty(index), ways(arrays_.addresses)[index], arrays_.next_uses != nullptr ? ways(arrays_.next_uses)[index] : 0};
+}
+
+void Set::save(CheckpointWriter &out) const {
+    out.put(state_.lru_clock);
+    out.put(state_.first);
+    out.put(state_.last);
+    out.put(state_.count);
+}
+
+bool Set::load(CheckpointReader &in) {
+    return in.get(state_.lru_clock) && in.get(state_.first) && in.get(state_.last) && in.get(state_.count) &&
+        state_.first >= 0 && state_.first < arrays_.associativity && state_.last >= 0 && state_.count >= 0 &&
+        state_.count <= arrays_.associativity;
+}
@@ -1,13 +1,34 @@
 #ifndef SET_H
 #define SET_H
 
-#include <vector>
-#include <string>
+#include <cstddef>
+#include <cstdint>
+
+class CheckpointWriter;
+class CheckpointReader;
 
 enum ReplacementPolicy {
         LRU,
         FIFO,
-        RANDOM
+        RANDOM,
+        OPTIMAL,
+        SRRIP,
+        BRRIP,
+        DRRIP,
+        PLRU
+};
+
+// the re-reference interval prediction policies, a 2-bit prediction per way
+inline bool is_rrip(ReplacementPolicy replacement) {
+    return replacement == SRRIP || replacement == BRRIP || replacement == DRRIP;
+}
+
+// DRRIP set dueling: a few leader sets always insert like SRRIP or BRRIP, the followers like the one
+// missing less in its leaders
+enum DuelRole {
+    DUEL_FOLLOWER,
+    DUEL_SRRIP,
+    DUEL_BRRIP,
 };
 
 enum InclusionPolicy {
@@ -22,50 +43,207 @@ enum Mode {
     INVALIDATE
 };
 
+// coherence state of a block in a private cache of a multicore run
+enum MesiState {
+    MESI_INVALID,
+    MESI_SHARED,
+    MESI_EXCLUSIVE,
+    MESI_MODIFIED,
+};
+
 struct CacheBlock {
-    std::string tag;
+    uint64_t tag = 0;
     // a valid bit to the tag to say whether or not this entry contains a valid address.
     // If the bit is not set, there cannot be a match on this address
     bool valid = false;
     // If it is clean, the block is not written back on a miss
     bool dirty = false;
-    std::string address_hex;
+    // the address that brought this block in, passed to the next level on eviction
+    uint64_t address = 0;
+    // OPTIMAL only, the trace record that touches this block next (see NextUse)
+    uint32_t next_use = 0;
 };
 
+// xorshift64* generator for RANDOM replacement, one per cache so a run is reproducible for its seed
+struct XorShift64 {
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+
+    void seed(uint64_t seed);
+    uint64_t next();
+    // uniform in [0, n)
+    int below(int n);
+};
+
+// prefetch accounting of a cache with a prefetcher, shared by its sets
+struct PrefetchStats {
+    // prefetches that brought a block in
+    uint64_t issued = 0;
+    // prefetched blocks a demand access used
+    uint64_t useful = 0;
+    // of the useful ones, those used before the prefetch had arrived
+    uint64_t late = 0;
+    // prefetched blocks evicted or invalidated without a use
+    uint64_t useless = 0;
+    // accesses to the cache so far, and the accesses a prefetch takes to arrive
+    uint64_t clock = 0;
+    int latency = 0;
+};
+
+// The replacement state of a set that is not per way
+struct SetState {
+    // LRU order: a larger stamp is more recently used
+    uint64_t lru_clock = 0;
+    // FIFO: the oldest way, the next way to fill and the ways filled so far
+    int first = 0;
+    int last = 0;
+    int count = 0;
+};
+
+// The flat (structure of arrays) storage of all the sets of a Cache, which owns the arrays.
+// Way w of set s is element s * associativity + w of the arrays, and bit w % 64 of word
+// s * words_per_set + w / 64 of the bitmaps.
+struct SetArrays {
+    int associativity;
+    int words_per_set;
+    ReplacementPolicy replacement;
+    uint64_t *tags;
+    uint64_t *addresses;
+    uint64_t *valid;
+    uint64_t *dirty;
+    // clean and possibly cached by another core (MESI S rather than E), cleared by put
+    uint64_t *shared;
+    // one per set
+    SetState *states;
+    // LRU only, nullptr otherwise
+    uint64_t *lru_stamps;
+    // RANDOM and BRRIP / DRRIP, shared by all sets of the cache
+    XorShift64 *rng;
+    // OPTIMAL only: the next use of every way, and per set a max-heap of its ways on it.
+    // opt_slot[w] is the position of way w in the heap of its set
+    uint32_t *next_uses;
+    int *opt_heap;
+    int *opt_slot;
+    // bitmap with every way of a set set, one set's worth
+    const uint64_t *all_ways;
+    // with a prefetcher only, nullptr otherwise: bitmap of the ways a prefetch filled and no demand
+    // access used yet, the PrefetchStats clock of each fill, and the counters of the cache
+    uint64_t *prefetched = nullptr;
+    uint64_t *prefetch_times = nullptr;
+    PrefetchStats *prefetch_stats = nullptr;
+    // RRIP only: the re-reference prediction value of every way, a bitmap of the low bits and one of the high bits
+    uint64_t *rrip_low = nullptr;
+    uint64_t *rrip_high = nullptr;
+    // DRRIP only: the policy selection counter of the cache, counting up on misses of SRRIP leaders.
+    // Set s leads for SRRIP if s % leader_spacing is 0 and for BRRIP if it is 1, no set leads if 0
+    int *psel = nullptr;
+    int leader_spacing = 0;
+    // PLRU only: the associativity - 1 nodes of the tree of every set, node n (from 1, children 2n
+    // and 2n + 1) is bit n. A set bit says the victim is in the right subtree
+    uint64_t *plru_bits = nullptr;
+};
+
+// A Set is a view of one set's blocks inside the storage of its Cache, made from the set index
+// when the set is accessed. Nothing is kept per set but the arrays, so a cache does not allocate
+// per set and a tag lookup scans one contiguous run of tags.
 class Set {
 public:
-    Set(int associativity, ReplacementPolicy replace, InclusionPolicy inclusion = NON_INCLUSIVE);
+    Set(const SetArrays &arrays, int index);
     ~Set() = default;
 
-    bool fifo_access(const CacheBlock &block, std::string &viticm_hex, Mode mode, bool &set_dirty, bool &victim_dirty, int &writeback_memory);
+    int get_index() const { return index_; }
+
+    // if hit, return true. if missed, return false, and victim.valid is set when a block was evicted
+    bool fifo_access(const CacheBlock &block, CacheBlock &victim, Mode mode, bool &set_dirty, uint64_t &writeback_memory);
+
+    // every policy but FIFO: a miss fills an invalid way first, then evicts the policy's victim.
+    // if hit, return true. if missed, return false, and victim.valid is set when a block was evicted
+    bool access(const CacheBlock &block, CacheBlock &victim, Mode mode, bool &set_dirty, uint64_t &writeback_memory);
+
+    // OPTIMAL: the block was used by a cache closer to the CPU, move its next use on
+    void refresh_next_use(const CacheBlock &block);
+
+    // EXCLUSIVE: place a block evicted from the level above, it keeps its dirty bit.
+    // return true if a block was evicted to make room
+    bool insert(const CacheBlock &block, CacheBlock &victim);
+    // EXCLUSIVE: take the block out when the level above takes it, return false if it isn't here
+    bool remove(const CacheBlock &block, bool &dirty);
+    // EXCLUSIVE: the block came dirty from the level below
+    void mark_dirty(const CacheBlock &block);
+
+    // MESI: state of block, a valid block is M if dirty, S if shared and E otherwise
+    MesiState state(const CacheBlock &block);
+    // MESI: another core reads (READ, M and E become S) or writes (INVALIDATE) the block.
+    // The replacement state is not touched. Return the state before
+    MesiState snoop(const CacheBlock &block, Mode mode);
+    void set_shared(const CacheBlock &block, bool shared);
 
-    // if missed, return true, and the address of the block to be write to child
-    bool lru_access(const CacheBlock &block, std::string &viticm_hex, Mode mode, bool &set_dirty, bool &victim_dirty, int &writeback_memory);
+    // a prefetcher's block: fill it like a miss and mark it prefetched, without touching the counters
+    // of the cache. Return false if it is here already, victim.valid is set when a block was evicted
+    bool prefetch(const CacheBlock &block, CacheBlock &victim);
 
-    CacheBlock& operator[](int);
+    CacheBlock operator[](int) const;
+
+    // the SetState of the set, the blocks are saved with the Cache arrays
+    void save(CheckpointWriter &out) const;
+    bool load(CheckpointReader &in);
 
 private:
+    // this set's slice of an array with an element per way, and of a bitmap
+    template <typename T>
+    T *ways(T *array) const { return array + way_; }
+    uint64_t *words(uint64_t *bitmap) const { return bitmap + word_; }
+
     int fifo_hit_index(const CacheBlock &block);
     int fifo_empty_index();
 
     int lru_empty_index();
     int lru_hit_index(const CacheBlock &block);
-    void set_row_unset_column(int i);
-    int all_0_row();
-
-
-    std::vector<CacheBlock> blocks_;
-    std::vector<std::vector<bool>> lru_matrix_;
-    
-    int associativity_;
-    ReplacementPolicy replace_;
-    InclusionPolicy inclusion_;
-
-
-    // Used for FIFO
-    int first_;
-    int last_;
-    int count_;
+    // the miss path: put block in an empty way or the policy's victim, return the way
+    int fill(const CacheBlock &block, CacheBlock &victim);
+    int fifo_fill(const CacheBlock &block, CacheBlock &victim);
+
+    // update the replacement state when way i is hit, or filled, with block
+    void touch(int i, const CacheBlock &block, bool filled);
+    // the way to evict from a full set
+    int choose_victim();
+    // mark block i as most recently used
+    void lru_touch(int i);
+    // the least recently used block, every block of the set must have been touched
+    int lru_victim_index();
+    // give way i a new next use and restore the heap, O(log associativity)
+    void opt_update(int i, uint32_t next_use);
+    void opt_swap(int a, int b);
+    // RRIP: set the prediction of way i, from 0 (re-referenced soon) to kRripDistant
+    void rrip_set(int i, int prediction);
+    // DRRIP: whether this set leads for a policy or follows PSEL
+    DuelRole duel() const;
+    // DRRIP: a demand miss in a leader set counts against its policy, prefetches and inserts don't
+    void duel_miss();
+    // RRIP: the prediction of a filled block, DRRIP leader sets use their own policy, followers PSEL's
+    int rrip_insertion();
+    // RRIP: the first way predicted distant, ageing the whole set until one is
+    int rrip_victim_index();
+    // PLRU: point every node on the path to way i away from it, O(log associativity)
+    void plru_touch(int i);
+    int plru_victim_index() const;
+
+    // a demand access (or the level above taking the block) used way i, count it if prefetched
+    void use_prefetched(int i);
+    // way i loses its block, count it as useless if it was prefetched and never used
+    void drop_prefetched(int i);
+
+    // store block in way i
+    void put(int i, const CacheBlock &block);
+    bool is_dirty(int i) const;
+    void set_dirty_bit(int i);
+    void clear_valid_bit(int i);
+
+    const SetArrays &arrays_;
+    int index_;
+    // the first element of this set in the arrays, and its first word of the bitmaps
+    size_t way_;
+    size_t word_;
+    SetState &state_;
 };
 
 #endif
\ No newline at end of file
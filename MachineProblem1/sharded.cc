@@ -0,0 +1,221 @@
+#include "sharded.h"
+#include <algorithm>
+#include <barrier>
+#include <bit>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <thread>
+
+ShardedCache::ShardedCache(int size, int block_size, int associativity, ReplacementPolicy replacement, int max_shards) {
+    int set_count = std::max(1, size / std::max(1, block_size * associativity));
+    // a power of 2 no larger than the set count, so every shard gets whole sets
+    int shard_count = std::bit_floor(unsigned(std::clamp(max_shards, 1, set_count)));
+    offset_bits = block_size > 0 ? std::bit_width(unsigned(block_size)) - 1 : 0;
+    index_bits = std::bit_width(unsigned(set_count)) - 1;
+    shard_bits = std::bit_width(unsigned(shard_count)) - 1;
+    for (int s = 0; s < shard_count; s++) {
+        shards.push_back(std::make_unique<Cache>(size / shard_count, block_size, associativity, replacement));
+    }
+}
+
+int ShardedCache::shard_of(uint64_t address) const {
+    uint64_t index = (address >> offset_bits) & ((uint64_t(1) << index_bits) - 1);
+    return index >> (index_bits - shard_bits);
+}
+
+CacheStats ShardedCache::get_stats() const {
+    CacheStats stats;
+    for (const auto &shard : shards) {
+        stats += shard->get_stats();
+    }
+    return stats;
+}
+
+void ShardedCache::print_cache(const std::string &cache_name) {
+    std::cout << "===== " << cache_name << " =====" << std::endl;
+    int sets_per_shard = 1 << (index_bits - shard_bits);
+    for (size_t s = 0; s < shards.size(); s++) {
+        shards[s]->print_sets(s * sets_per_shard, shard_bits);
+    }
+}
+
+ShardedSystem::ShardedSystem(int block_size, int l1_size, int l1_assoc, int l2_size, int l2_assoc,
+    ReplacementPolicy replacement, InclusionPolicy inclusion, int threads)
+    : l1_(l1_size, block_size, l1_assoc, replacement, threads) {
+
+    if (replacement != LRU && replacement != FIFO) {
+        std::cerr << "Sharded runs support LRU and FIFO replacement!" << std::endl;
+        exit(1);
+    }
+    if (l2_size != 0 && inclusion != NON_INCLUSIVE) {
+        std::cerr << "Sharded runs support a non-inclusive L2!" << std::endl;
+        exit(1);
+    }
+    if (l2_size != 0) {
+        l2_ = std::make_unique<ShardedCache>(l2_size, block_size, l2_assoc, replacement, threads);
+    }
+    size_t l2_shards = l2_ ? l2_->shards.size() : 0;
+    for (auto &requests : requests_) {
+        requests.assign(l1_.shards.size(), std::vector<std::vector<Request>>(l2_shards));
+    }
+}
+
+bool ShardedSystem::fill_chunk(TraceReader &reader) {
+    chunk_start_ += chunk_size_;
+    chunk_size_ = 0;
+    for (size_t s = 0; s < chunk_.size(); s++) {
+        chunk_[s].clear();
+        positions_[s].clear();
+    }
+    while (chunk_size_ < kChunkSize) {
+        size_t count = reader.read_memory(batch_.data(), std::min(batch_.size(), kChunkSize - chunk_size_));
+        if (count == 0) {
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (batch_[i].op != 'r' && batch_[i].op != 'w') {
+                std::cerr << "Invalid operation!" << std::endl;
+                exit(1);
+            }
+            int shard = l1_.shard_of(batch_[i].address);
+            chunk_[shard].push_back(batch_[i]);
+            positions_[shard].push_back(chunk_start_ + chunk_size_ + i);
+        }
+        chunk_size_ += count;
+    }
+    if (reader.failed()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    return chunk_size_ != 0;
+}
+
+void ShardedSystem::run_l1(int shard, int parity) {
+    Cache &l1 = *l1_.shards[shard];
+    const std::vector<MemoryRecord> &records = chunk_[shard];
+    const std::vector<uint64_t> &positions = positions_[shard];
+    std::vector<std::vector<Request>> &requests = requests_[parity][shard];
+    for (auto &queue : requests) {
+        queue.clear();
+    }
+    for (size_t i = 0; i < records.size(); i++) {
+        const MemoryRecord &record = records[i];
+        if (record.op == 'r') {
+            l1.read(record.address);
+        } else {
+            l1.write(record.address);
+        }
+        if (!l2_ || !l1.get_last_missed()) {
+            continue;
+        }
+        // the writeback of the victim, followed by the read, as Cache::access does
+        const CacheBlock &victim = l1.get_last_victim();
+        if (victim.valid && victim.dirty) {
+            requests[l2_->shard_of(victim.address)].push_back(Request{positions[i], WRITE, victim.address});
+        }
+        requests[l2_->shard_of(record.address)].push_back(Request{positions[i], READ, record.address});
+    }
+}
+
+void ShardedSystem::run_l2(int shard, int parity) {
+    Cache &l2 = *l2_->shards[shard];
+    // every record went to one L1 shard, so merging the queues on position restores trace order
+    using Head = std::pair<uint64_t, size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    std::vector<size_t> next(l1_.shards.size(), 0);
+    for (size_t s = 0; s < l1_.shards.size(); s++) {
+        if (!requests_[parity][s][shard].empty()) {
+            heads.push({requests_[parity][s][shard][0].position, s});
+        }
+    }
+    while (!heads.empty()) {
+        size_t s = heads.top().second;
+        heads.pop();
+        const std::vector<Request> &queue = requests_[parity][s][shard];
+        const Request &request = queue[next[s]++];
+        if (request.mode == WRITE) {
+            l2.write(request.address);
+        } else {
+            l2.read(request.address);
+        }
+        if (next[s] < queue.size()) {
+            heads.push({queue[next[s]].position, s});
+        }
+    }
+}
+
+void ShardedSystem::run(const std::string &trace_file) {
+    TraceReader reader(trace_file);
+    if (!reader.is_open()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    batch_.resize(TraceReader::kBatchSize);
+    chunk_.resize(l1_.shards.size());
+    positions_.resize(l1_.shards.size());
+
+    // worker w runs L1 shard w and L2 shard w, when there are that many; the caller is worker 0
+    int l1_shards = l1_.shards.size();
+    int l2_shards = l2_ ? l2_->shards.size() : 0;
+    int workers = std::max(l1_shards, l2_shards);
+    bool l1_busy = false;
+    bool l2_busy = false;
+    int parity = 0;
+    std::barrier sync(workers);
+    auto step = [&](int worker) {
+        if (l1_busy && worker < l1_shards) {
+            run_l1(worker, parity);
+        }
+        if (l2_busy && worker < l2_shards) {
+            run_l2(worker, parity ^ 1);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int w = 1; w < workers; w++) {
+        pool.emplace_back([&, w]() {
+            while (true) {
+                sync.arrive_and_wait();
+                if (!l1_busy && !l2_busy) {
+                    return;
+                }
+                step(w);
+                sync.arrive_and_wait();
+            }
+        });
+    }
+    while (true) {
+        // the L2 drains what the L1 queued in the last step
+        l2_busy = l1_busy && l2_;
+        l1_busy = fill_chunk(reader);
+        parity ^= 1;
+        sync.arrive_and_wait();
+        if (!l1_busy && !l2_busy) {
+            break;
+        }
+        step(0);
+        sync.arrive_and_wait();
+    }
+    for (std::thread &worker : pool) {
+        worker.join();
+    }
+}
+
+void ShardedSystem::print_results() {
+    l1_.print_cache("L1 contents");
+    if (l2_) {
+        l2_->print_cache("L2 contents");
+    }
+
+    std::cout << "===== Simulation results (raw) =====" << std::endl;
+    CacheStats l1 = l1_.get_stats();
+    Cache::print_summary(l1, "L1", 'a', true);
+    if (l2_) {
+        CacheStats l2 = l2_->get_stats();
+        Cache::print_summary(l2, "L2", 'g', false);
+        Cache::print_traffic(l2.read_misses + l2.write_misses + l2.writebacks, 'm');
+    } else {
+        Cache::print_summary(CacheStats(), "L2", 'g', true);
+        Cache::print_traffic(l1.read_misses + l1.write_misses + l1.writebacks, 'm');
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef SHARDED_H
+#define SHARDED_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "trace_reader.h"
+
+// A cache split by the high bits of its set index into shard caches of size / shards. A shard sees
+// only the addresses of its sets, and with the index bits it no longer has moved into its tags it
+// hits and evicts exactly like those sets of the whole cache.
+struct ShardedCache {
+    ShardedCache(int size, int block_size, int associativity, ReplacementPolicy replacement, int max_shards);
+
+    int shard_of(uint64_t address) const;
+    CacheStats get_stats() const;
+    // print_cache of the whole cache
+    void print_cache(const std::string &cache_name);
+
+    std::vector<std::unique_ptr<Cache>> shards;
+    int offset_bits;
+    int index_bits;
+    int shard_bits;
+};
+
+// One sim_cache run with the sets of the L1 (and L2) sharded over threads, same results as the
+// serial run. The trace is decoded in chunks, each split into a queue of records per L1 shard. In
+// every step, each worker runs its L1 shard's queue of the current chunk, queuing the L1 writebacks and misses per L2 shard in
+// trace order, and runs its L2 shard on the requests the L1 shards queued for the previous chunk,
+// merged back into trace order. So L1 and L2 work on consecutive chunks at the same time.
+// Every set must be independent of the others: LRU or FIFO replacement (RANDOM draws from one
+// generator for all sets, OPTIMAL needs the whole trace), and a non-inclusive L2 (an inclusive or
+// exclusive L2 reaches back into the L1).
+class ShardedSystem {
+public:
+    static constexpr size_t kChunkSize = 1 << 16;
+
+    ShardedSystem(int block_size, int l1_size, int l1_assoc, int l2_size, int l2_assoc,
+        ReplacementPolicy replacement, InclusionPolicy inclusion, int threads);
+    ~ShardedSystem() = default;
+
+    void run(const std::string &trace_file);
+
+    // contents and counters in the format of a serial run
+    void print_results();
+
+private:
+    // an L1 writeback (WRITE) or miss (READ) for the L2
+    struct Request {
+        // record of the trace that caused it
+        uint64_t position;
+        Mode mode;
+        uint64_t address;
+    };
+
+    // decode the next chunk of the trace into the queues of the L1 shards, return false at the end
+    bool fill_chunk(TraceReader &reader);
+    void run_l1(int shard, int parity);
+    void run_l2(int shard, int parity);
+
+    ShardedCache l1_;
+    std::unique_ptr<ShardedCache> l2_;
+
+    std::vector<MemoryRecord> batch_;
+    // chunk_[l1 shard] holds the shard's records of the chunk in trace order, positions_ their place in the trace
+    std::vector<std::vector<MemoryRecord>> chunk_;
+    std::vector<std::vector<uint64_t>> positions_;
+    uint64_t chunk_start_ = 0;
+    size_t chunk_size_ = 0;
+    // requests_[parity][l1 shard][l2 shard], the L1 fills one parity while the L2 drains the other
+    std::vector<std::vector<std::vector<Request>>> requests_[2];
+};
+
+#endif // SHARDED_H
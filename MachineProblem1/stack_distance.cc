@@ -0,0 +1,142 @@
+#include "stack_distance.h"
+#include <bit>
+#include <format>
+#include <iostream>
+
+namespace {
+
+constexpr uint32_t kInitialSlots = 64;
+
+} // namespace
+
+void StackDistance::SetStack::add(uint32_t slot, int delta) {
+    for (; slot < tree.size(); slot += slot & -slot) {
+        tree[slot] += delta;
+    }
+}
+
+int StackDistance::SetStack::prefix(uint32_t slot) const {
+    int sum = 0;
+    for (; slot > 0; slot -= slot & -slot) {
+        sum += tree[slot];
+    }
+    return sum;
+}
+
+StackDistance::StackDistance(int block_size, int set_count, int max_assoc)
+    : block_size_(block_size), set_count_(set_count), max_assoc_(max_assoc),
+    read_distance_(max_assoc, 0), write_distance_(max_assoc, 0) {
+
+    if (!std::has_single_bit(unsigned(block_size)) || !std::has_single_bit(unsigned(set_count))) {
+        std::cerr << "block_size and set_count must be powers of 2" << std::endl;
+        exit(1);
+    }
+    offset_bits_ = std::countr_zero(unsigned(block_size));
+
+    sets_ = std::vector<SetStack>(set_count_);
+    for (SetStack &set : sets_) {
+        // slot 0 is unused, Fenwick trees are 1-based
+        set.tree.assign(kInitialSlots + 1, 0);
+        set.slot_block.assign(kInitialSlots + 1, 0);
+        set.live.assign(kInitialSlots + 1, false);
+    }
+}
+
+void StackDistance::read(uint64_t address) {
+    access(address, READ);
+}
+
+void StackDistance::write(uint64_t address) {
+    access(address, WRITE);
+}
+
+void StackDistance::access(uint64_t address, Mode mode) {
+    uint64_t block = address >> offset_bits_;
+    SetStack &set = sets_[block & (set_count_ - 1)];
+    if (set.time == set.tree.size()) {
+        compact(set);
+    }
+
+    // distinct blocks used after the last use of this block, 0 is the MRU position
+    uint64_t distance = max_assoc_;
+    auto found = last_use_.find(block);
+    if (found != last_use_.end()) {
+        uint32_t last = found->second;
+        distance = set.prefix(set.time - 1) - set.prefix(last);
+        set.add(last, -1);
+        set.live[last] = false;
+        found->second = set.time;
+    } else {
+        last_use_.emplace(block, set.time);
+    }
+    set.add(set.time, 1);
+    set.live[set.time] = true;
+    set.slot_block[set.time] = block;
+    ++set.time;
+
+    if (mode == READ) {
+        ++reads_;
+        if (distance < uint64_t(max_assoc_)) {
+            ++read_distance_[distance];
+        }
+    } else {
+        ++writes_;
+        if (distance < uint64_t(max_assoc_)) {
+            ++write_distance_[distance];
+        }
+    }
+}
+
+void StackDistance::compact(SetStack &set) {
+    uint32_t capacity = set.tree.size() - 1;
+    std::vector<uint64_t> blocks;
+    for (uint32_t slot = 1; slot < set.time; ++slot) {
+        if (set.live[slot]) {
+            blocks.push_back(set.slot_block[slot]);
+        }
+    }
+    if (blocks.size() * 2 > capacity) {
+        capacity *= 2;
+    }
+    set.tree.assign(capacity + 1, 0);
+    set.slot_block.assign(capacity + 1, 0);
+    set.live.assign(capacity + 1, false);
+
+    set.time = 1;
+    for (uint64_t block : blocks) {
+        uint32_t slot = set.time++;
+        set.slot_block[slot] = block;
+        set.live[slot] = true;
+        set.tree[slot] = 1;
+        last_use_[block] = slot;
+    }
+    // build the tree in O(n) by pushing every node into its parent
+    for (uint32_t slot = 1; slot <= capacity; ++slot) {
+        uint32_t parent = slot + (slot & -slot);
+        if (parent <= capacity) {
+            set.tree[parent] += set.tree[slot];
+        }
+    }
+}
+
+void StackDistance::print_curve() {
+    std::cout << "===== Stack distance (LRU) =====" << std::endl;
+    std::cout << std::format("{:<23}", "BLOCKSIZE:") << block_size_ << std::endl;
+    std::cout << std::format("{:<23}", "SETS:") << set_count_ << std::endl;
+    std::cout << std::format("{:<8}{:<12}{:<12}{:<14}{:<12}{:<14}{}", "assoc", "size", "reads", "read misses",
+        "writes", "write misses", "miss rate") << std::endl;
+
+    // misses of an assoc-way cache are the accesses with distance >= assoc
+    uint64_t read_misses = reads_;
+    uint64_t write_misses = writes_;
+    int distance = 0;
+    for (int assoc = 1; assoc <= max_assoc_; assoc *= 2) {
+        for (; distance < assoc; ++distance) {
+            read_misses -= read_distance_[distance];
+            write_misses -= write_distance_[distance];
+        }
+        double miss_rate = reads_ + writes_ == 0 ? 0 : (read_misses + write_misses) / double(reads_ + writes_);
+        std::cout << std::format("{:<8}{:<12}{:<12}{:<14}{:<12}{:<14}{:.6f}", assoc,
+            uint64_t(assoc) * set_count_ * block_size_, reads_, read_misses, writes_, write_misses, miss_rate) << std::endl;
+    }
+}
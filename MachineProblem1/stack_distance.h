@@ -0,0 +1,61 @@
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "set.h"
+
+// Mattson stack-distance analysis for LRU. One pass over the trace gives the misses of every
+// associativity (and so every size) for a fixed block size and set count: an access misses in
+// an assoc-way LRU set exactly when its stack distance within the set is >= assoc.
+//
+// Each set counts the distinct blocks touched since the last use of a block with a Fenwick tree
+// over set-local time, which has a 1 at the last use of every block, so a lookup is O(log n).
+class StackDistance {
+public:
+    StackDistance(int block_size, int set_count, int max_assoc);
+    ~StackDistance() = default;
+
+    void read(uint64_t address);
+    void write(uint64_t address);
+
+    // misses for assoc = 1, 2, 4, ... max_assoc, same counters as Cache::print_summary for L1
+    void print_curve();
+
+private:
+    void access(uint64_t address, Mode mode);
+
+    struct SetStack {
+        // Fenwick tree over slots 1..capacity, slot_block[t] is the block used at time t
+        std::vector<int> tree;
+        std::vector<uint64_t> slot_block;
+        std::vector<bool> live;
+        uint32_t time = 1;
+
+        void add(uint32_t slot, int delta);
+        // number of live slots in 1..slot
+        int prefix(uint32_t slot) const;
+    };
+
+    // renumber the live slots of a full set, grow it when more than half are live
+    void compact(SetStack &set);
+
+    int block_size_;
+    int set_count_;
+    int max_assoc_;
+    int offset_bits_;
+
+    std::vector<SetStack> sets_;
+    // block number -> set-local time of its last use
+    std::unordered_map<uint64_t, uint32_t> last_use_;
+
+    // histograms of stack distances below max_assoc_, everything else (and first uses) always misses
+    std::vector<uint64_t> read_distance_;
+    std::vector<uint64_t> write_distance_;
+    uint64_t reads_ = 0;
+    uint64_t writes_ = 0;
+};
+
+#endif // STACK_DISTANCE_H
@@ -0,0 +1,317 @@
+#include "sweep.h"
+#include "cache.h"
+#include "next_use.h"
+#include "trace_reader.h"
+#include <algorithm>
+#include <barrier>
+#include <bit>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+// a batch is simulated by all hierarchies while the next one is decoded
+constexpr size_t kSweepBatchSize = 1 << 16;
+
+struct Hierarchy {
+    SweepConfig config;
+    std::shared_ptr<Cache> l1;
+    std::shared_ptr<Cache> l2;
+};
+
+const char *replacement_name(ReplacementPolicy replacement) {
+    if (replacement == FIFO) {
+        return "FIFO";
+    } else if (replacement == RANDOM) {
+        return "RANDOM";
+    } else if (replacement == OPTIMAL) {
+        return "OPTIMAL";
+    } else if (replacement == SRRIP) {
+        return "SRRIP";
+    } else if (replacement == BRRIP) {
+        return "BRRIP";
+    } else if (replacement == DRRIP) {
+        return "DRRIP";
+    } else if (replacement == PLRU) {
+        return "PLRU";
+    }
+    return "LRU";
+}
+
+const char *inclusion_name(InclusionPolicy inclusion) {
+    if (inclusion == INCLUSIVE) {
+        return "inclusive";
+    } else if (inclusion == EXCLUSIVE) {
+        return "exclusive";
+    }
+    return "non-inclusive";
+}
+
+// parse "a,b,lo:hi" into values, lo:hi expands to the powers of 2 in between
+bool parse_field(const std::string &field, std::vector<int> &values) {
+    std::stringstream ss(field);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        try {
+            size_t colon = item.find(':');
+            if (colon == std::string::npos) {
+                values.push_back(std::stoi(item));
+                continue;
+            }
+            int lo = std::stoi(item.substr(0, colon));
+            int hi = std::stoi(item.substr(colon + 1));
+            if (lo <= 0 || hi < lo) {
+                return false;
+            }
+            for (long value = lo; value <= hi; value *= 2) {
+                values.push_back(value);
+            }
+        } catch (std::exception const &) {
+            return false;
+        }
+    }
+    return !values.empty();
+}
+
+// skip grid points the Cache constructor would reject, which would end the whole sweep: a cache
+// needs a power-of-2 block size and number of sets, and PLRU a power-of-2 associativity
+bool valid_cache(int size, int block_size, int assoc, ReplacementPolicy replacement) {
+    if (block_size <= 0 || assoc <= 0 || size < block_size * assoc || size % (block_size * assoc) != 0) {
+        return false;
+    }
+    return std::has_single_bit(unsigned(block_size)) && std::has_single_bit(unsigned(size / (block_size * assoc))) &&
+        (replacement != PLRU || std::has_single_bit(unsigned(assoc)));
+}
+
+Hierarchy build_hierarchy(const SweepConfig &config, uint64_t seed, const std::map<int, NextUse> &next_uses) {
+    Hierarchy hierarchy{config, std::make_shared<Cache>(config.l1_size, config.block_size, config.l1_assoc,
+        config.replacement, config.inclusion), nullptr};
+    hierarchy.l1->set_seed(seed);
+    if (config.replacement == OPTIMAL) {
+        hierarchy.l1->set_next_use(&next_uses.at(config.block_size));
+    }
+    if (config.l2_size != 0) {
+        hierarchy.l2 = std::make_shared<Cache>(config.l2_size, config.block_size, config.l2_assoc,
+            config.replacement, config.inclusion);
+        hierarchy.l2->set_seed(seed + 1);
+        hierarchy.l1->set_child(hierarchy.l2);
+        hierarchy.l2->add_parent(hierarchy.l1);
+    }
+    return hierarchy;
+}
+
+void simulate(std::vector<Hierarchy> &hierarchies, size_t first, size_t step,
+    const std::vector<MemoryRecord> &batch, size_t count) {
+    for (size_t h = first; h < hierarchies.size(); h += step) {
+        Cache &l1 = *hierarchies[h].l1;
+        for (size_t i = 0; i < count; ++i) {
+            if (batch[i].op == 'r') {
+                l1.read(batch[i].address);
+            } else {
+                l1.write(batch[i].address);
+            }
+        }
+    }
+}
+
+// read the next batch, and check the operations so the workers don't have to
+size_t read_batch(TraceReader &reader, std::vector<MemoryRecord> &batch) {
+    size_t count = reader.read_memory(batch.data(), batch.size());
+    for (size_t i = 0; i < count; ++i) {
+        if (batch[i].op != 'r' && batch[i].op != 'w') {
+            std::cerr << "Invalid operation!" << std::endl;
+            exit(1);
+        }
+    }
+    if (reader.failed()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    return count;
+}
+
+double l1_miss_rate(const CacheStats &stats) {
+    uint64_t accesses = stats.reads + stats.writes;
+    return accesses == 0 ? 0 : (stats.read_misses + stats.write_misses) / (double)accesses;
+}
+
+double l2_miss_rate(const CacheStats &stats) {
+    return stats.reads == 0 ? 0 : stats.read_misses / (double)stats.reads;
+}
+
+void write_row(const Hierarchy &hierarchy, SweepFormat format, bool first, std::ostream &out) {
+    const SweepConfig &c = hierarchy.config;
+    CacheStats l1 = hierarchy.l1->get_stats();
+    CacheStats l2 = hierarchy.l2 != nullptr ? hierarchy.l2->get_stats() : CacheStats();
+    uint64_t traffic = hierarchy.l2 != nullptr ? hierarchy.l2->get_memory_traffic() : hierarchy.l1->get_memory_traffic();
+
+    if (format == SWEEP_CSV) {
+        out << std::format("{},{},{},{},{},{},{},", c.block_size, c.l1_size, c.l1_assoc, c.l2_size, c.l2_assoc,
+            replacement_name(c.replacement), inclusion_name(c.inclusion));
+        out << std::format("{},{},{},{},{:.6f},{},", l1.reads, l1.read_misses, l1.writes, l1.write_misses,
+            l1_miss_rate(l1), l1.writebacks);
+        out << std::format("{},{},{},{},{:.6f},{},", l2.reads, l2.read_misses, l2.writes, l2.write_misses,
+            l2_miss_rate(l2), l2.writebacks);
+        out << traffic << std::endl;
+    } else {
+        out << (first ? "" : ",\n");
+        out << std::format("  {{\"block_size\": {}, \"l1_size\": {}, \"l1_assoc\": {}, \"l2_size\": {}, \"l2_assoc\": {}, "
+            "\"replacement\": \"{}\", \"inclusion\": \"{}\", ", c.block_size, c.l1_size, c.l1_assoc, c.l2_size, c.l2_assoc,
+            replacement_name(c.replacement), inclusion_name(c.inclusion));
+        out << std::format("\"l1_reads\": {}, \"l1_read_misses\": {}, \"l1_writes\": {}, \"l1_write_misses\": {}, "
+            "\"l1_miss_rate\": {:.6f}, \"l1_writebacks\": {}, ", l1.reads, l1.read_misses, l1.writes, l1.write_misses,
+            l1_miss_rate(l1), l1.writebacks);
+        out << std::format("\"l2_reads\": {}, \"l2_read_misses\": {}, \"l2_writes\": {}, \"l2_write_misses\": {}, "
+            "\"l2_miss_rate\": {:.6f}, \"l2_writebacks\": {}, ", l2.reads, l2.read_misses, l2.writes, l2.write_misses,
+            l2_miss_rate(l2), l2.writebacks);
+        out << std::format("\"memory_traffic\": {}}}", traffic);
+    }
+}
+
+} // namespace
+
+bool parse_sweep_grid(const std::string &line, std::vector<SweepConfig> &configs) {
+    std::istringstream iss(line);
+    std::vector<std::vector<int>> fields;
+    std::string field;
+    while (iss >> field) {
+        fields.emplace_back();
+        if (!parse_field(field, fields.back())) {
+            return false;
+        }
+    }
+    if (fields.size() != 7) {
+        return false;
+    }
+    for (int replacement : fields[5]) {
+        if (replacement < LRU || replacement > PLRU) {
+            return false;
+        }
+    }
+    for (int inclusion : fields[6]) {
+        if (inclusion != NON_INCLUSIVE && inclusion != INCLUSIVE && inclusion != EXCLUSIVE) {
+            return false;
+        }
+    }
+
+    for (int block_size : fields[0])
+    for (int l1_size : fields[1])
+    for (int l1_assoc : fields[2])
+    for (int l2_size : fields[3])
+    for (int l2_assoc : fields[4])
+    for (int replacement : fields[5])
+    for (int inclusion : fields[6]) {
+        SweepConfig config{block_size, l1_size, l1_assoc, l2_size, l2_assoc,
+            ReplacementPolicy(replacement), InclusionPolicy(inclusion)};
+        // L2_ASSOC means nothing without an L2
+        if (config.l2_size == 0) {
+            config.l2_assoc = 0;
+        }
+        if (!valid_cache(config.l1_size, config.block_size, config.l1_assoc, config.replacement) ||
+            (config.l2_size != 0 && !valid_cache(config.l2_size, config.block_size, config.l2_assoc, config.replacement))) {
+            continue;
+        }
+        if (std::find(configs.begin(), configs.end(), config) == configs.end()) {
+            configs.push_back(config);
+        }
+    }
+    return true;
+}
+
+bool read_sweep_file(const std::string &path, std::vector<SweepConfig> &configs) {
+    std::ifstream infile(path);
+    if (!infile.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(infile, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        if (!parse_sweep_grid(line, configs)) {
+            std::cerr << "Invalid sweep line: " << line << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void run_sweep(const std::vector<SweepConfig> &configs, const std::string &trace_file, int threads,
+    uint64_t seed, SweepFormat format, std::ostream &out) {
+    // OPT configs share one pre-pass per block size
+    std::map<int, NextUse> next_uses;
+    for (const SweepConfig &config : configs) {
+        if (config.replacement == OPTIMAL && !next_uses.contains(config.block_size)) {
+            auto it = next_uses.try_emplace(config.block_size, config.block_size).first;
+            if (!it->second.build(trace_file)) {
+                std::cerr << "Invalid trace file!" << std::endl;
+                exit(1);
+            }
+        }
+    }
+    std::vector<Hierarchy> hierarchies;
+    for (const SweepConfig &config : configs) {
+        hierarchies.push_back(build_hierarchy(config, seed, next_uses));
+    }
+
+    TraceReader reader(trace_file);
+    if (!reader.is_open()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+
+    size_t workers = std::clamp<size_t>(threads, 1, std::max<size_t>(hierarchies.size(), 1));
+    std::vector<MemoryRecord> current(kSweepBatchSize);
+    std::vector<MemoryRecord> next(kSweepBatchSize);
+    size_t count = read_batch(reader, current);
+    // every worker owns the hierarchies w, w + workers, ... for the whole run; the caller is worker 0
+    // and decodes the next batch before simulating its share of the current one
+    std::barrier sync(workers);
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < workers; ++w) {
+        pool.emplace_back([&, w]() {
+            while (true) {
+                sync.arrive_and_wait();
+                if (count == 0) {
+                    return;
+                }
+                simulate(hierarchies, w, workers, current, count);
+                sync.arrive_and_wait();
+            }
+        });
+    }
+    while (true) {
+        sync.arrive_and_wait();
+        if (count == 0) {
+            break;
+        }
+        size_t next_count = read_batch(reader, next);
+        simulate(hierarchies, 0, workers, current, count);
+        sync.arrive_and_wait();
+        current.swap(next);
+        count = next_count;
+    }
+    for (std::thread &worker : pool) {
+        worker.join();
+    }
+
+    if (format == SWEEP_CSV) {
+        out << "block_size,l1_size,l1_assoc,l2_size,l2_assoc,replacement,inclusion,"
+            "l1_reads,l1_read_misses,l1_writes,l1_write_misses,l1_miss_rate,l1_writebacks,"
+            "l2_reads,l2_read_misses,l2_writes,l2_write_misses,l2_miss_rate,l2_writebacks,memory_traffic" << std::endl;
+    } else {
+        out << "[" << std::endl;
+    }
+    for (size_t h = 0; h < hierarchies.size(); ++h) {
+        write_row(hierarchies[h], format, h == 0, out);
+    }
+    if (format == SWEEP_JSON) {
+        out << (hierarchies.empty() ? "" : "\n") << "]" << std::endl;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "set.h"
+
+// one point of the design space, same fields as the sim_cache command line
+struct SweepConfig {
+    int block_size;
+    int l1_size;
+    int l1_assoc;
+    int l2_size;
+    int l2_assoc;
+    ReplacementPolicy replacement;
+    InclusionPolicy inclusion;
+
+    bool operator==(const SweepConfig &) const = default;
+};
+
+enum SweepFormat {
+    SWEEP_CSV,
+    SWEEP_JSON,
+};
+
+// A grid line has the 7 fields of the command line:
+//   <BLOCKSIZE> <L1_SIZE> <L1_ASSOC> <L2_SIZE> <L2_ASSOC> <REPLACEMENT_POLICY> <INCLUSION_PROPERTY>
+// each field is a comma separated list of values or power-of-2 ranges lo:hi, e.g.
+//   16,32 1024:8192 1:4 0,16384 4 0 0
+// Every combination that gives each cache a power-of-2 block size and number of sets (and a
+// power-of-2 associativity for PLRU) is appended to configs, the others and duplicates are
+// dropped. Return false on a syntax error.
+bool parse_sweep_grid(const std::string &line, std::vector<SweepConfig> &configs);
+
+// read grid lines from a file, blank lines and lines starting with '#' are skipped
+bool read_sweep_file(const std::string &path, std::vector<SweepConfig> &configs);
+
+// decode the trace once and drive one L1(/L2) hierarchy per config, sharded over threads.
+// seed is used for RANDOM, BRRIP and DRRIP replacement as in a single run.
+// writes one row per config with the print_summary / print_traffic counters
+void run_sweep(const std::vector<SweepConfig> &configs, const std::string &trace_file, int threads,
+    uint64_t seed, SweepFormat format, std::ostream &out);
+
+#endif // SWEEP_H
@@ -0,0 +1,77 @@
+#include "tag_match.h"
+#include <algorithm>
+#include <bit>
+#include <immintrin.h>
+
+FindTagFunction g_find_tag = best_find_tag();
+
+int find_tag_scalar(const uint64_t *tags, const uint64_t *mask, int ways, uint64_t tag) {
+    for (int w = 0; w < ways; w++) {
+        if (tags[w] == tag && ((mask[w / 64] >> (w % 64)) & 1)) {
+            return w;
+        }
+    }
+    return -1;
+}
+
+__attribute__((target("sse4.1")))
+int find_tag_sse4(const uint64_t *tags, const uint64_t *mask, int ways, uint64_t tag) {
+    const __m128i needle = _mm_set1_epi64x(tag);
+    for (int base = 0; base < ways; base += 64) {
+        int end = std::min(ways, base + 64);
+        uint64_t matches = 0;
+        int w = base;
+        for (; w + 2 <= end; w += 2) {
+            __m128i ways_tags = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tags + w));
+            uint64_t hit = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(ways_tags, needle)));
+            matches |= hit << (w - base);
+        }
+        for (; w < end; w++) {
+            matches |= uint64_t(tags[w] == tag) << (w - base);
+        }
+        matches &= mask[base / 64];
+        if (matches != 0) {
+            return base + std::countr_zero(matches);
+        }
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+int find_tag_avx2(const uint64_t *tags, const uint64_t *mask, int ways, uint64_t tag) {
+    const __m256i needle = _mm256_set1_epi64x(tag);
+    for (int base = 0; base < ways; base += 64) {
+        int end = std::min(ways, base + 64);
+        uint64_t matches = 0;
+        int w = base;
+        for (; w + 4 <= end; w += 4) {
+            __m256i ways_tags = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags + w));
+            uint64_t hit = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(ways_tags, needle)));
+            matches |= hit << (w - base);
+        }
+        for (; w < end; w++) {
+            matches |= uint64_t(tags[w] == tag) << (w - base);
+        }
+        matches &= mask[base / 64];
+        if (matches != 0) {
+            return base + std::countr_zero(matches);
+        }
+    }
+    return -1;
+}
+
+FindTagFunction best_find_tag() {
+    // g_find_tag is initialised before main
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return find_tag_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return find_tag_sse4;
+    }
+    return find_tag_scalar;
+}
+
+void use_simd_tag_lookup(bool enable) {
+    g_find_tag = enable ? best_find_tag() : find_tag_scalar;
+}
@@ -0,0 +1,36 @@
+#ifndef TAG_MATCH_H
+#define TAG_MATCH_H
+
+#include <cstdint>
+
+// Tag lookup over one set of the flat tag array: return the first way < ways whose tag equals
+// tag and whose bit is set in the mask bitmap (bit w % 64 of mask[w / 64]), or -1.
+// Sets of 16 ways or more compare 4 (AVX2) or 2 (SSE4.1) ways per instruction, picked by CPU
+// at startup. Smaller sets are faster with the early-exit scalar loop (see bench/tag_lookup_bench.cc).
+using FindTagFunction = int (*)(const uint64_t *tags, const uint64_t *mask, int ways, uint64_t tag);
+
+int find_tag_scalar(const uint64_t *tags, const uint64_t *mask, int ways, uint64_t tag);
+int find_tag_sse4(const uint64_t *tags, const uint64_t *mask, int ways, uint64_t tag);
+int find_tag_avx2(const uint64_t *tags, const uint64_t *mask, int ways, uint64_t tag);
+
+// the best SIMD lookup this CPU supports, or find_tag_scalar
+FindTagFunction best_find_tag();
+
+// pick the SIMD (default) or the scalar lookup for every cache, results are the same
+void use_simd_tag_lookup(bool enable);
+
+extern FindTagFunction g_find_tag;
+
+inline int find_tag(const uint64_t *tags, const uint64_t *mask, int ways, uint64_t tag) {
+    if (ways < 16) {
+        for (int w = 0; w < ways; w++) {
+            if (tags[w] == tag && ((mask[0] >> w) & 1)) {
+                return w;
+            }
+        }
+        return -1;
+    }
+    return g_find_tag(tags, mask, ways, tag);
+}
+
+#endif // TAG_MATCH_H
@@ -0,0 +1,43 @@
+// DRRIP set dueling in small caches: the sets that follow PSEL must pick the better of SRRIP and
+// BRRIP, so DRRIP misses less than a fixed half-and-half split of the two
+#include <cstdio>
+#include "cache.h"
+
+namespace {
+
+// a cyclic working set of 6 blocks in every set of a 4-way cache, which thrashes SRRIP and which
+// BRRIP keeps part of, long enough for PSEL to settle with a single pair of leaders
+uint64_t misses(ReplacementPolicy replacement, int set_count) {
+    const int block_size = 16;
+    const int associativity = 4;
+    Cache cache(set_count * associativity * block_size, block_size, associativity, replacement);
+    for (int round = 0; round < 1000; round++) {
+        for (uint64_t way = 0; way < 6; way++) {
+            for (uint64_t set = 0; set < uint64_t(set_count); set++) {
+                cache.read((way * set_count + set) * block_size);
+            }
+        }
+    }
+    return cache.get_stats().read_misses;
+}
+
+} // namespace
+
+int main() {
+    int failures = 0;
+    for (int set_count : {4, 8, 32, 64}) {
+        uint64_t srrip = misses(SRRIP, set_count);
+        uint64_t brrip = misses(BRRIP, set_count);
+        uint64_t drrip = misses(DRRIP, set_count);
+        bool ok = brrip < srrip && drrip < (srrip + brrip) / 2;
+        std::printf("%s %d sets: SRRIP %llu BRRIP %llu DRRIP %llu misses\n", ok ? "PASS" : "FAIL", set_count, (unsigned long long)srrip, (unsigned long long)brrip, (unsigned long long)drrip);
+        failures += !ok;
+    }
+    // too few sets for leaders, every set follows PSEL at its start, which is SRRIP
+    for (int set_count : {1, 2}) {
+        bool ok = misses(DRRIP, set_count) == misses(SRRIP, set_count);
+        std::printf("%s %d sets: DRRIP is SRRIP\n", ok ? "PASS" : "FAIL", set_count);
+        failures += !ok;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#include "timing.h"
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// the access time of the smallest row at least as big as the cache
+const struct {
+    int size;
+    int cycles;
+} kSizeLatencies[] = {
+    {1 << 10, 1}, {1 << 11, 1}, {1 << 12, 2}, {1 << 13, 2}, {1 << 14, 3}, {1 << 15, 3}, {1 << 16, 4},
+    {1 << 17, 6}, {1 << 18, 8}, {1 << 19, 10}, {1 << 20, 12}, {1 << 21, 15}, {1 << 22, 19}, {1 << 23, 24},
+    {1 << 24, 30},
+};
+// anything bigger than the last row
+const int kLargestLatency = 36;
+
+} // namespace
+
+bool LatencyTable::read_file(const std::string &path) {
+    std::ifstream infile(path);
+    if (!infile.is_open()) {
+        std::cerr << "Invalid latency file!" << std::endl;
+        return false;
+    }
+    bool memory = false;
+    std::string line;
+    while (std::getline(infile, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        std::istringstream iss(line);
+        std::string first, rest;
+        Row row;
+        bool ok;
+        if (iss >> first && first == "memory") {
+            ok = !memory && iss >> memory_latency_ && memory_latency_ > 0;
+            memory = true;
+        } else {
+            iss.clear();
+            iss.str(line);
+            ok = iss >> row.size >> row.associativity >> row.cycles && row.size > 0 && row.associativity > 0 &&
+                row.cycles > 0;
+            rows_.push_back(row);
+        }
+        if (!ok || iss >> rest) {
+            std::cerr << "Invalid latency line: " << line << std::endl;
+            return false;
+        }
+    }
+    source_ = path;
+    return true;
+}
+
+int LatencyTable::cache_latency(int size, int associativity) const {
+    for (const Row &row : rows_) {
+        if (row.size == size && row.associativity == associativity) {
+            return row.cycles;
+        }
+    }
+    int cycles = kLargestLatency;
+    for (const auto &entry : kSizeLatencies) {
+        if (entry.size >= size) {
+            cycles = entry.cycles;
+            break;
+        }
+    }
+    // the wider tag compare and way select of a more associative cache
+    return cycles + (associativity >= 4) + (associativity >= 16);
+}
+
+TimingModel::TimingModel(int mshrs) : mshrs_(mshrs) {
+}
+
+void TimingModel::access(int latency, int hit_latency) {
+    ++accesses_;
+    latency_ += latency;
+    if (mshrs_ == 0 || latency <= hit_latency) {
+        cycle_ += latency;
+        return;
+    }
+    while (!outstanding_.empty() && outstanding_.top() <= cycle_) {
+        outstanding_.pop();
+    }
+    // every MSHR is busy, the miss waits for one
+    if (int(outstanding_.size()) == mshrs_) {
+        cycle_ = outstanding_.top();
+        outstanding_.pop();
+    }
+    outstanding_.push(cycle_ + latency);
+    last_done_ = std::max(last_done_, cycle_ + latency);
+    cycle_ += hit_latency;
+}
+
+void TimingModel::print_summary(int memory_latency, uint64_t memory_cycles, char start_char, int width) const {
+    std::cout << start_char << ". " << std::format("{:<{}}", "memory latency:", width) << memory_latency << std::endl;
+    std::cout << char(start_char + 1) << ". " << std::format("{:<{}}", "memory stall cycles:", width) << memory_cycles << std::endl;
+    // the latency the CPU didn't wait for, hidden behind other accesses
+    std::cout << char(start_char + 2) << ". " << std::format("{:<{}}", "overlapped cycles:", width)
+        << latency_ - std::min(latency_, get_cycles()) << std::endl;
+    std::cout << char(start_char + 3) << ". " << std::format("{:<{}}", "total cycles:", width) << get_cycles() << std::endl;
+    std::cout << char(start_char + 4) << ". " << std::format("{:<{}}", "average access time:", width)
+        << std::format("{:.4f}", accesses_ == 0 ? 0 : latency_ / (double)accesses_) << std::endl;
+}
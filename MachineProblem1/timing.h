@@ -0,0 +1,76 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+// Access times in cycles. A cache's depends on its size and associativity, from a built-in table
+// (roughly what CACTI gives at 3 GHz) or from the rows of a latency file.
+class LatencyTable {
+public:
+    static const int kDefaultMemoryLatency = 200;
+
+    // A latency file has lines "<SIZE> <ASSOC> <CYCLES>" and at most one "memory <CYCLES>", blank
+    // lines and lines starting with '#' are skipped. A row overrides the built-in latency of caches
+    // of that size and associativity. Return false and print the reason if the file is invalid.
+    bool read_file(const std::string &path);
+
+    int cache_latency(int size, int associativity) const;
+    int memory_latency() const { return memory_latency_; }
+    // "built-in" or the latency file
+    const std::string &get_source() const { return source_; }
+
+private:
+    struct Row {
+        int size;
+        int associativity;
+        int cycles;
+    };
+    std::vector<Row> rows_;
+    int memory_latency_ = kDefaultMemoryLatency;
+    std::string source_ = "built-in";
+};
+
+// --timing and --mshr
+struct TimingOptions {
+    LatencyTable latencies;
+    // 0 for a CPU that blocks on every miss
+    int mshrs = 0;
+};
+
+// The cycles of a run on an in-order CPU that issues an access every L1 hit latency. Without MSHRs
+// a miss stalls the CPU until its block arrives. With them, the CPU goes on after a miss while
+// fewer than mshrs misses are outstanding, and waits for the oldest otherwise. Writebacks and
+// prefetches are off the critical path.
+class TimingModel {
+public:
+    explicit TimingModel(int mshrs);
+
+    // a CPU access that took latency cycles, a miss if that's more than the first level's hit latency
+    void access(int latency, int hit_latency);
+
+    uint64_t get_accesses() const { return accesses_; }
+    // the sum of the latencies, what the CPU would wait without overlap
+    uint64_t get_latency() const { return latency_; }
+    // when the last outstanding miss is done
+    uint64_t get_cycles() const { return std::max(cycle_, last_done_); }
+
+    // memory latency and stall cycles, overlap, total cycles and AMAT, labels padded to width
+    void print_summary(int memory_latency, uint64_t memory_cycles, char start_char, int width = 27) const;
+
+private:
+    int mshrs_;
+    uint64_t accesses_ = 0;
+    uint64_t latency_ = 0;
+    // the cycle the CPU issues its next access at
+    uint64_t cycle_ = 0;
+    // the cycles the outstanding misses finish at, soonest first
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> outstanding_;
+    uint64_t last_done_ = 0;
+};
+
+#endif // TIMING_H
@@ -0,0 +1,62 @@
+#include "victim_cache.h"
+
+namespace {
+
+const uint64_t kEmpty = ~uint64_t(0);
+
+} // namespace
+
+VictimCache::VictimCache(int entries, int offset_bits)
+    : offset_bits_(offset_bits), block_numbers_(entries, kEmpty), blocks_(entries), stamps_(entries, 0) {
+}
+
+int VictimCache::find(uint64_t address) const {
+    uint64_t block_number = address >> offset_bits_;
+    for (size_t i = 0; i < block_numbers_.size(); i++) {
+        if (block_numbers_[i] == block_number) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool VictimCache::take(uint64_t address, CacheBlock &block) {
+    ++lookups_;
+    int i = find(address);
+    if (i == -1) {
+        return false;
+    }
+    ++hits_;
+    block = blocks_[i];
+    block_numbers_[i] = kEmpty;
+    blocks_[i] = CacheBlock();
+    stamps_[i] = 0;
+    return true;
+}
+
+bool VictimCache::insert(const CacheBlock &block, CacheBlock &evicted) {
+    // an empty entry has stamp 0, so it is taken before any valid one
+    int lru = 0;
+    for (size_t i = 1; i < stamps_.size(); i++) {
+        if (stamps_[i] < stamps_[lru]) {
+            lru = i;
+        }
+    }
+    evicted = blocks_[lru];
+    block_numbers_[lru] = block.address >> offset_bits_;
+    blocks_[lru] = block;
+    stamps_[lru] = ++clock_;
+    return evicted.valid;
+}
+
+bool VictimCache::invalidate(uint64_t address, bool &dirty) {
+    int i = find(address);
+    if (i == -1) {
+        return false;
+    }
+    dirty = blocks_[i].dirty;
+    block_numbers_[i] = kEmpty;
+    blocks_[i] = CacheBlock();
+    stamps_[i] = 0;
+    return true;
+}
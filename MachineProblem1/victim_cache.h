@@ -0,0 +1,42 @@
+#ifndef VICTIM_CACHE_H
+#define VICTIM_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "set.h"
+
+// A small fully associative LRU cache of the blocks a cache evicts, looked up on its misses
+// before the level below. A hit moves the block back into the cache.
+class VictimCache {
+public:
+    VictimCache(int entries, int offset_bits);
+
+    // take the block of address out, return false if it isn't here
+    bool take(uint64_t address, CacheBlock &block);
+    // place a block the cache evicted, return true and set evicted when the LRU entry has to go
+    bool insert(const CacheBlock &block, CacheBlock &evicted);
+    // an inclusive level below dropped the block, return true if it was here, dirty tells how
+    bool invalidate(uint64_t address, bool &dirty);
+
+    int get_entries() const { return int(blocks_.size()); }
+    uint64_t get_lookups() const { return lookups_; }
+    uint64_t get_hits() const { return hits_; }
+
+private:
+    // the entry holding the block of address, or -1
+    int find(uint64_t address) const;
+
+    int offset_bits_;
+    // block numbers (address without offset) of the valid entries scanned on a lookup, ~0 if empty
+    std::vector<uint64_t> block_numbers_;
+    std::vector<CacheBlock> blocks_;
+    // LRU order: a larger stamp is more recently inserted
+    std::vector<uint64_t> stamps_;
+    uint64_t clock_ = 0;
+
+    uint64_t lookups_ = 0;
+    uint64_t hits_ = 0;
+};
+
+#endif // VICTIM_CACHE_H
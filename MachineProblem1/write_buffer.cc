@@ -0,0 +1,56 @@
+#include "write_buffer.h"
+
+WriteBuffer::WriteBuffer(int entries, int offset_bits)
+    : offset_bits_(offset_bits), block_numbers_(entries, 0), blocks_(entries) {
+}
+
+int WriteBuffer::find(uint64_t address) const {
+    uint64_t block_number = address >> offset_bits_;
+    int size = int(blocks_.size());
+    for (int n = 0; n < count_; n++) {
+        int i = (first_ + n) % size;
+        if (block_numbers_[i] == block_number) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool WriteBuffer::write(const CacheBlock &block, CacheBlock &drained) {
+    ++writes_;
+    int i = find(block.address);
+    if (i != -1) {
+        // the newer data replaces the buffered one, still one write to the level below
+        ++merges_;
+        blocks_[i].next_use = block.next_use;
+        return false;
+    }
+    bool full = count_ == int(blocks_.size());
+    if (full) {
+        drain(drained);
+    }
+    int last = (first_ + count_) % int(blocks_.size());
+    block_numbers_[last] = block.address >> offset_bits_;
+    blocks_[last] = block;
+    ++count_;
+    return full;
+}
+
+bool WriteBuffer::read(uint64_t address) {
+    if (find(address) == -1) {
+        return false;
+    }
+    ++read_hits_;
+    return true;
+}
+
+bool WriteBuffer::drain(CacheBlock &drained) {
+    if (count_ == 0) {
+        return false;
+    }
+    ++drains_;
+    drained = blocks_[first_];
+    first_ = (first_ + 1) % int(blocks_.size());
+    --count_;
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef WRITE_BUFFER_H
+#define WRITE_BUFFER_H
+
+#include <cstdint>
+#include <vector>
+#include "set.h"
+
+// A coalescing write buffer for the writebacks a cache sends to the level below. A writeback
+// of a block already buffered merges with it. When the buffer is full, the oldest entry drains
+// to the level below. A miss of the cache on a buffered block is served from the buffer.
+class WriteBuffer {
+public:
+    WriteBuffer(int entries, int offset_bits);
+
+    // buffer a dirty block, return true and set drained when the oldest entry has to go first
+    bool write(const CacheBlock &block, CacheBlock &drained);
+    // a miss of the cache: return true (a read hit) if the buffer has the block of address
+    bool read(uint64_t address);
+    // take the oldest entry out, return false if the buffer is empty
+    bool drain(CacheBlock &drained);
+
+    int get_entries() const { return int(blocks_.size()); }
+    uint64_t get_writes() const { return writes_; }
+    uint64_t get_merges() const { return merges_; }
+    uint64_t get_read_hits() const { return read_hits_; }
+    uint64_t get_drains() const { return drains_; }
+
+private:
+    int find(uint64_t address) const;
+
+    int offset_bits_;
+    // a ring of count_ entries from first_, in the order they were buffered
+    std::vector<uint64_t> block_numbers_;
+    std::vector<CacheBlock> blocks_;
+    int first_ = 0;
+    int count_ = 0;
+
+    uint64_t writes_ = 0;
+    uint64_t merges_ = 0;
+    uint64_t read_hits_ = 0;
+    uint64_t drains_ = 0;
+};
+
+#endif // WRITE_BUFFER_H
@@ -0,0 +1,224 @@
+#include "batch.h"
+#include "smith.h"
+#include "hybrid.h"
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+constexpr size_t kBatchBranches = 1 << 16;
+
+// fields each predictor takes on the command line
+int field_count(const std::string &predictor) {
+    if (predictor == "smith" || predictor == "bimodal") {
+        return 1;
+    } else if (predictor == "gshare") {
+        return 2;
+    } else if (predictor == "hybrid") {
+        return 4;
+    }
+    return 0;
+}
+
+// parse "a,b,lo:hi" into values, lo:hi expands to every value in between
+bool parse_field(const std::string &field, std::vector<int> &values) {
+    std::stringstream ss(field);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        try {
+            size_t colon = item.find(':');
+            int lo = std::stoi(item.substr(0, colon));
+            int hi = colon == std::string::npos ? lo : std::stoi(item.substr(colon + 1));
+            if (lo < 0 || hi < lo || hi > 30) {
+                return false;
+            }
+            for (int value = lo; value <= hi; ++value) {
+                values.push_back(value);
+            }
+        } catch (std::exception const &) {
+            return false;
+        }
+    }
+    return !values.empty();
+}
+
+// the same config on the sim command line
+std::string config_name(const PredictorConfig &config) {
+    std::string name = config.predictor;
+    for (int param : config.params) {
+        name += std::format(" {}", param);
+    }
+    return name;
+}
+
+void write_row(const PredictorConfig &config, uint64_t predictions, uint64_t mispredictions, std::ostream &out) {
+    double rate = predictions == 0 ? 0 : (double)mispredictions / predictions * 100;
+    out << std::format("{},{},{},{:.2f}", config_name(config), predictions, mispredictions, rate) << std::endl;
+}
+
+} // namespace
+
+bool parse_predictor_grid(const std::string &line, std::vector<PredictorConfig> &configs) {
+    std::istringstream iss(line);
+    std::string predictor;
+    iss >> predictor;
+    std::vector<std::vector<int>> fields;
+    std::string field;
+    while (iss >> field) {
+        fields.emplace_back();
+        if (!parse_field(field, fields.back())) {
+            return false;
+        }
+    }
+    if (field_count(predictor) == 0 || int(fields.size()) != field_count(predictor)) {
+        return false;
+    }
+
+    // every combination of the fields, odometer style
+    std::vector<size_t> position(fields.size(), 0);
+    while (true) {
+        PredictorConfig config{predictor, {}};
+        for (size_t f = 0; f < fields.size(); ++f) {
+            config.params.push_back(fields[f][position[f]]);
+        }
+        // the history of gshare (alone or in hybrid) is at most M1 bits, smith needs a bit
+        bool valid = true;
+        if (predictor == "gshare") {
+            valid = config.params[1] <= config.params[0];
+        } else if (predictor == "hybrid") {
+            valid = config.params[2] <= config.params[1];
+        } else if (predictor == "smith") {
+            valid = config.params[0] >= 1;
+        }
+        if (valid && std::find(configs.begin(), configs.end(), config) == configs.end()) {
+            configs.push_back(config);
+        }
+        size_t f = 0;
+        while (f < fields.size() && ++position[f] == fields[f].size()) {
+            position[f++] = 0;
+        }
+        if (f == fields.size()) {
+            break;
+        }
+    }
+    return true;
+}
+
+bool read_predictor_grid_file(const std::string &path, std::vector<PredictorConfig> &configs) {
+    std::ifstream infile(path);
+    if (!infile.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(infile, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        if (!parse_predictor_grid(line, configs)) {
+            std::cerr << "Invalid grid line: " << line << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void GshareBatch::add(int m, int n) {
+    pc_mask_.push_back((uint32_t(1) << m) - 1);
+    history_bit_.push_back(n == 0 ? 0 : uint32_t(1) << (n - 1));
+    history_.push_back(0);
+    index_.push_back(0);
+    table_.push_back(counters_.size());
+    // counters start weakly taken, as in Gshare
+    counters_.resize(counters_.size() + (size_t(1) << m), 4);
+    mispredictions_.push_back(0);
+}
+
+void GshareBatch::run(const BranchRecord *records, size_t count) {
+    size_t predictors = size();
+    uint32_t *index = index_.data();
+    uint32_t *history = history_.data();
+    const uint32_t *pc_mask = pc_mask_.data();
+    const uint32_t *history_bit = history_bit_.data();
+    for (size_t r = 0; r < count; ++r) {
+        // bits m+1 to 2 of the pc
+        uint32_t pc = uint32_t(records[r].pc >> 2);
+        bool taken = records[r].taken;
+        for (size_t i = 0; i < predictors; ++i) {
+            index[i] = (pc & pc_mask[i]) ^ history[i];
+        }
+        for (size_t i = 0; i < predictors; ++i) {
+            uint8_t &counter = counters_[table_[i] + index[i]];
+            mispredictions_[i] += (counter >= 4) != taken;
+            counter += uint8_t(taken & (counter != 7)) - uint8_t(!taken & (counter != 0));
+        }
+        uint32_t taken_mask = -uint32_t(taken);
+        for (size_t i = 0; i < predictors; ++i) {
+            history[i] = (history[i] >> 1) | (history_bit[i] & taken_mask);
+        }
+    }
+    predictions_ += count;
+}
+
+void run_batch(const std::vector<PredictorConfig> &configs, const std::string &trace_file, std::ostream &out) {
+    // where each config runs: its slot in the batch or in the list of its class
+    std::vector<size_t> slot;
+    GshareBatch gshares;
+    std::vector<SmithPredictor> smiths;
+    std::vector<Hybrid> hybrids;
+    for (const PredictorConfig &config : configs) {
+        const std::vector<int> &p = config.params;
+        if (config.predictor == "smith") {
+            slot.push_back(smiths.size());
+            smiths.emplace_back(p[0]);
+        } else if (config.predictor == "bimodal") {
+            slot.push_back(gshares.size());
+            gshares.add(p[0], 0);
+        } else if (config.predictor == "gshare") {
+            slot.push_back(gshares.size());
+            gshares.add(p[0], p[1]);
+        } else {
+            slot.push_back(hybrids.size());
+            hybrids.emplace_back(p[0], p[1], p[2], p[3]);
+        }
+    }
+
+    TraceReader reader(trace_file);
+    if (!reader.is_open()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    std::vector<BranchRecord> batch(kBatchBranches);
+    while (size_t count = reader.read_branches(batch.data(), batch.size())) {
+        gshares.run(batch.data(), count);
+        for (SmithPredictor &smith : smiths) {
+            for (size_t i = 0; i < count; ++i) {
+                smith.predict(batch[i].taken);
+            }
+        }
+        for (Hybrid &hybrid : hybrids) {
+            for (size_t i = 0; i < count; ++i) {
+                hybrid.predict(batch[i].pc, batch[i].taken);
+            }
+        }
+    }
+    if (reader.failed()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+
+    out << "config,predictions,mispredictions,misprediction_rate" << std::endl;
+    for (size_t c = 0; c < configs.size(); ++c) {
+        const std::string &predictor = configs[c].predictor;
+        if (predictor == "smith") {
+            write_row(configs[c], smiths[slot[c]].get_predictions(), smiths[slot[c]].get_mispredictions(), out);
+        } else if (predictor == "hybrid") {
+            write_row(configs[c], hybrids[slot[c]].get_predictions(), hybrids[slot[c]].get_mispredictions(), out);
+        } else {
+            write_row(configs[c], gshares.predictions(), gshares.mispredictions(slot[c]), out);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "trace_reader.h"
+
+// one predictor of a batch run, the fields of the sim command line:
+// smith <B>, bimodal <M2>, gshare <M1> <N>, hybrid <K> <M1> <N> <M2>
+struct PredictorConfig {
+    std::string predictor;
+    std::vector<int> params;
+
+    bool operator==(const PredictorConfig &) const = default;
+};
+
+// A grid line is a predictor followed by its fields, each field a comma separated list of
+// values or inclusive ranges lo:hi, e.g.
+//   gshare 8:16 0:8
+// Every combination is appended to configs, gshare with N > M1 is dropped, duplicates too.
+// Return false on a syntax error.
+bool parse_predictor_grid(const std::string &line, std::vector<PredictorConfig> &configs);
+
+// read grid lines from a file, blank lines and lines starting with '#' are skipped
+bool read_predictor_grid_file(const std::string &path, std::vector<PredictorConfig> &configs);
+
+// Gshare (and bimodal, N = 0) predictors run in lockstep, with the state of every predictor in
+// flat per-field arrays. For each branch the table indexes of all predictors and then their
+// history registers are computed in loops the compiler vectorises, only the counter lookups and
+// updates go predictor by predictor. Same counters and history as Gshare.
+class GshareBatch {
+public:
+    void add(int m, int n);
+    size_t size() const { return pc_mask_.size(); }
+
+    void run(const BranchRecord *records, size_t count);
+
+    uint64_t predictions() const { return predictions_; }
+    uint64_t mispredictions(size_t i) const { return mispredictions_[i]; }
+
+private:
+    std::vector<uint32_t> pc_mask_;
+    // 1 << (n - 1), the bit a taken branch sets in the history, 0 for bimodal
+    std::vector<uint32_t> history_bit_;
+    std::vector<uint32_t> history_;
+    std::vector<uint32_t> index_;
+    // every table is a run of 3 bit counters, a byte each, in counters_
+    std::vector<size_t> table_;
+    std::vector<uint8_t> counters_;
+    std::vector<uint64_t> mispredictions_;
+    uint64_t predictions_ = 0;
+};
+
+// decode the trace once and run every config, smith and hybrid configs with their classes and
+// gshare / bimodal ones with GshareBatch. Write one CSV row per config:
+// config, predictions, mispredictions and the misprediction rate in percent
+void run_batch(const std::vector<PredictorConfig> &configs, const std::string &trace_file, std::ostream &out);
+
+#endif // BATCH_H
@@ -0,0 +1,58 @@
+#ifndef COUNTER_TABLE_H
+#define COUNTER_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Table of Bits-bit saturating counters packed into 64 bit words, 64 / Bits counters a word
+// (a 3-bit counter takes 3 bits instead of a 20 byte SmithPredictor). A counter predicts taken
+// in its upper half, like SmithPredictor.
+template <int Bits>
+class CounterTable {
+    static_assert(Bits >= 1 && Bits <= 8, "counters are 1 to 8 bits");
+
+public:
+    static constexpr uint64_t kMax = (uint64_t(1) << Bits) - 1;
+    static constexpr size_t kPerWord = 64 / Bits;
+
+    CounterTable(size_t size, uint64_t initial) : size_(size), words_((size + kPerWord - 1) / kPerWord, 0) {
+        for (size_t i = 0; i < size; ++i) {
+            set(i, initial);
+        }
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    uint64_t get(size_t i) const {
+        return (words_[i / kPerWord] >> shift(i)) & kMax;
+    }
+
+    void set(size_t i, uint64_t value) {
+        uint64_t &word = words_[i / kPerWord];
+        word = (word & ~(kMax << shift(i))) | ((value & kMax) << shift(i));
+    }
+
+    bool predict(size_t i) const {
+        return get(i) > kMax / 2;
+    }
+
+    // count up (taken) or down, saturating at 0 and kMax, without branches
+    void update(size_t i, bool up) {
+        uint64_t value = get(i);
+        value += uint64_t(up & (value != kMax)) - uint64_t(!up & (value != 0));
+        set(i, value);
+    }
+
+private:
+    static size_t shift(size_t i) {
+        return (i % kPerWord) * Bits;
+    }
+
+    size_t size_;
+    std::vector<uint64_t> words_;
+};
+
+#endif // COUNTER_TABLE_H
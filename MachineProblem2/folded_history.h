@@ -0,0 +1,58 @@
+#ifndef FOLDED_HISTORY_H
+#define FOLDED_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Global branch history of up to max_length outcomes in a circular buffer, at(0) is the newest
+class GlobalHistory {
+public:
+    explicit GlobalHistory(int max_length) {
+        size_t size = 1;
+        while (size < size_t(max_length) + 1) {
+            size <<= 1;
+        }
+        bits_.assign(size, 0);
+    }
+
+    void push(bool taken) {
+        head_ = (head_ - 1) & (bits_.size() - 1);
+        bits_[head_] = taken;
+    }
+
+    // the outcome i branches ago, at(length) is the one that just left a history of length
+    uint32_t at(int i) const {
+        return bits_[(head_ + i) & (bits_.size() - 1)];
+    }
+
+    std::vector<uint8_t> &bits() { return bits_; }
+    const std::vector<uint8_t> &bits() const { return bits_; }
+    size_t &head() { return head_; }
+    size_t head() const { return head_; }
+
+private:
+    std::vector<uint8_t> bits_;
+    size_t head_ = 0;
+};
+
+// The newest length outcomes of a GlobalHistory xor-folded into width bits. update() keeps it
+// current in O(1) per branch: shift the new outcome in, take the leaving one out where it landed.
+struct FoldedHistory {
+    FoldedHistory(int length, int width) : length(length), width(width), outpoint(length % width) {}
+
+    // call after every GlobalHistory::push
+    void update(const GlobalHistory &history) {
+        value = (value << 1) | history.at(0);
+        value ^= history.at(length) << outpoint;
+        value ^= value >> width;
+        value &= (uint32_t(1) << width) - 1;
+    }
+
+    uint32_t value = 0;
+    int length;
+    int width;
+    int outpoint;
+};
+
+#endif // FOLDED_HISTORY_H
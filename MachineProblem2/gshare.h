@@ -1,58 +1,57 @@
 #ifndef GSHARE_H
 #define GSHARE_H
 
-#include "smith.h"
+#include "counter_table.h"
+#include "checkpoint.h"
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
 #include <vector>
 
 class Gshare {
 public:
     Gshare(int m, int n) 
         : m_(m), n_(n), max_n_((1 << n) - 1), shift_register_(0),
-         predictions_(0), mispredictions_(0) {   
+         predictions_(0), mispredictions_(0), gshare_(size_t(1) << m, kInitialCounter) {
 
         if (n > m) {
             std::cerr << "n must <= m!" << std::endl;
             exit(1);
         }
-
-        for (int i = 0; i < (1 << m); ++i) {
-            gshare_.push_back(SmithPredictor(3));
-        }
-
-            
     }
 
     // if predict wrong, return false
-    bool predict(const std::string &address, bool taken) {
+    bool predict(uint64_t pc, bool taken) {
         bool ret = true;
 
-        bool predict_taken = predict_only(address);
+        bool predict_taken = predict_only(pc);
         if (predict_taken != taken) {
             ret = false;
         }
 
-        update_only(taken, predict_taken, address);
+        update_only(taken, predict_taken, pc);
 
         return ret;
     }
 
     // return predict result, true if taken
-    bool predict_only(const std::string &address) {
-        int index = gshare_index(address);
+    bool predict_only(uint64_t pc) {
+        int index = gshare_index(pc);
 
-        bool predict_taken = gshare_[index].predict_only();
+        bool predict_taken = gshare_.predict(index);
         return predict_taken;
     }
 
-    void update_only(bool taken, bool predict_taken, const std::string &address) {
+    void update_only(bool taken, bool predict_taken, uint64_t pc) {
         ++predictions_;
         if (predict_taken != taken) {
             ++mispredictions_;
         }
 
-        int index = gshare_index(address);
+        int index = gshare_index(pc);
 
-        gshare_[index].update_only(taken, predict_taken);
+        gshare_.update(index, taken);
 
         if (n_ != 0) {
             // most significant bit of shift register
@@ -62,7 +61,15 @@ public:
 
     }
 
-    void update_shift_register(bool taken) {
+    uint64_t get_predictions() const {
+        return predictions_;
+    }
+    uint64_t get_mispredictions() const {
+        return mispredictions_;
+    }
+
+    // the shift register must see every branch, even if gshare did not predict it
+    void update_history(bool taken) {
         if (n_ != 0) {
             // most significant bit of shift register
             int msb = (int)taken << (n_ - 1);
@@ -70,6 +77,36 @@ public:
         }
     }
 
+    void save(CheckpointWriter &out) const {
+        out.put(m_);
+        out.put(n_);
+        out.put(shift_register_);
+        out.put(predictions_);
+        out.put(mispredictions_);
+        // the 3 bit counters, a byte each
+        std::vector<uint8_t> counters(gshare_.size());
+        for (size_t i = 0; i < gshare_.size(); ++i) {
+            counters[i] = gshare_.get(i);
+        }
+        out.put(counters);
+    }
+
+    // false if the checkpoint is of another predictor
+    bool load(CheckpointReader &in) {
+        std::vector<uint8_t> counters(gshare_.size());
+        if (!(in.expect(m_) && in.expect(n_) && in.get(shift_register_) && in.get(predictions_) &&
+            in.get(mispredictions_) && in.get(counters))) {
+            return false;
+        }
+        for (size_t i = 0; i < gshare_.size(); ++i) {
+            if (counters[i] > Counters::kMax) {
+                return false;
+            }
+            gshare_.set(i, counters[i]);
+        }
+        return shift_register_ >= 0 && shift_register_ <= max_n_;
+    }
+
     void print_summary() {
         std::cout << "OUTPUT" << std::endl;
         std::cout << "number of predictions:\t\t" << predictions_ << std::endl;
@@ -84,7 +121,7 @@ public:
             std::cout << "FINAL BIMODAL CONTENTS" << std::endl;
 
         for (size_t i = 0; i < gshare_.size(); ++i) {
-            std::cout << std::to_string(i) << "\t" << gshare_[i].content() << std::endl;
+            std::cout << std::to_string(i) << "\t" << gshare_.get(i) << std::endl;
         }
     }
 
@@ -98,16 +135,17 @@ private:
     int max_n_;
     int shift_register_;
 
-    int predictions_;
-    int mispredictions_;
-
-    std::vector<SmithPredictor> gshare_;
+    uint64_t predictions_;
+    uint64_t mispredictions_;
 
-    int gshare_index(const std::string &address) {
-        int address_int = std::stoi(address, nullptr, 16);
+    // 3 bit counters, starting at 4 (weakly taken)
+    using Counters = CounterTable<3>;
+    static constexpr uint64_t kInitialCounter = 4;
+    Counters gshare_;
 
+    int gshare_index(uint64_t pc) {
         // use m+1 to 2 bits of pc
-        int pc_index = (address_int & ((1 << (m_ + 2)) - 1) ) >> 2;
+        int pc_index = (pc & ((uint64_t(1) << (m_ + 2)) - 1) ) >> 2;
 
         int index;
         if (n_ == 0) { // bimodal
@@ -1,37 +1,42 @@
 #ifndef HYBRID_H
 #define HYBRID_H
 
-#include "smith.h"
+#include "counter_table.h"
 #include "gshare.h"
+#include <utility>
 
-class Hybrid {
+// A chooser table picks First or Second per branch. A component has predict_only,
+// update_only (counters and history) and update_history (history only, when not chosen),
+// save / load and print_content, like Gshare, Tage and Perceptron.
+template <typename First, typename Second>
+class BasicHybrid {
 public:
-    Hybrid(int k, int m1, int n, int m2) 
-        : k_(k), chooser_table_(1 << k, 1), gshare_(m1, n), bimodal_(m2, 0), predictions_(0), mispredictions_(0) {
+    BasicHybrid(int k, First first, Second second)
+        : k_(k), chooser_table_(1 << k, 1), first_(std::move(first)), second_(std::move(second)),
+          predictions_(0), mispredictions_(0) {
         // do nothing 
         ;
     }
 
-    void predict(const std::string &address, bool taken) {
+    void predict(uint64_t pc, bool taken) {
         ++predictions_;
 
-        bool gshare_taken = gshare_.predict_only(address);
-        bool bimodal_taken = bimodal_.predict_only(address);
-
-        int address_int = std::stoi(address, nullptr, 16);
+        bool first_taken = first_.predict_only(pc);
+        bool second_taken = second_.predict_only(pc);
 
         // use k+1 to 2 bits of pc
-        int chooser_index = (address_int & ((1 << (k_ + 2)) - 1) ) >> 2;
+        int chooser_index = (pc & ((uint64_t(1) << (k_ + 2)) - 1) ) >> 2;
 
         bool overall_prediction = false;
-        if (chooser_table_[chooser_index] >= 2) {
-            overall_prediction = gshare_taken;
-            gshare_.update_only(taken, gshare_taken, address);
+        if (chooser_table_.predict(chooser_index)) {
+            overall_prediction = first_taken;
+            first_.update_only(taken, first_taken, pc);
+            // the other component's history must be updated, even if it is not chosen
+            second_.update_history(taken);
         } else {
-            overall_prediction = bimodal_taken;
-            bimodal_.update_only(taken, bimodal_taken, address);
-            // gshare's shift register must be updated, even if bimodal is chosen
-            gshare_.update_shift_register(taken);
+            overall_prediction = second_taken;
+            second_.update_only(taken, second_taken, pc);
+            first_.update_history(taken);
         }
 
         if (overall_prediction != taken) {
@@ -39,22 +44,52 @@ public:
         }
 
         // update chooser table
-        if (gshare_taken == bimodal_taken) { // both correct or both wrong
+        if (first_taken == second_taken) { // both correct or both wrong
             // do nothing
             ;
-        } else if (gshare_taken == taken) { // gshare correct, bimodal wrong
-            if (chooser_table_[chooser_index] != 3) {
-                ++chooser_table_[chooser_index];
-            }
-        } else {
-            if (chooser_table_[chooser_index] != 0) { // gshare wrong, bimodal correct
-                --chooser_table_[chooser_index];
-            }
+        } else { // one correct, count towards first if it is the one
+            chooser_table_.update(chooser_index, first_taken == taken);
         }
 
 
     }
 
+    uint64_t get_predictions() const {
+        return predictions_;
+    }
+    uint64_t get_mispredictions() const {
+        return mispredictions_;
+    }
+
+    void save(CheckpointWriter &out) const {
+        out.put(k_);
+        // the 2 bit counters, a byte each
+        std::vector<uint8_t> chooser(chooser_table_.size());
+        for (size_t i = 0; i < chooser_table_.size(); ++i) {
+            chooser[i] = chooser_table_.get(i);
+        }
+        out.put(chooser);
+        first_.save(out);
+        second_.save(out);
+        out.put(predictions_);
+        out.put(mispredictions_);
+    }
+
+    // false if the checkpoint is of another predictor
+    bool load(CheckpointReader &in) {
+        std::vector<uint8_t> chooser(chooser_table_.size());
+        if (!(in.expect(k_) && in.get(chooser))) {
+            return false;
+        }
+        for (size_t i = 0; i < chooser_table_.size(); ++i) {
+            if (chooser[i] > CounterTable<2>::kMax) {
+                return false;
+            }
+            chooser_table_.set(i, chooser[i]);
+        }
+        return first_.load(in) && second_.load(in) && in.get(predictions_) && in.get(mispredictions_);
+    }
+
     void print_summary() {
         std::cout << "OUTPUT" << std::endl;
         std::cout << "number of predictions:\t\t" << predictions_ << std::endl;
@@ -62,23 +97,30 @@ public:
         std::cout << "misprediction rate:\t\t" << std::format("{:.2f}%", (double)mispredictions_ / predictions_ * 100) << std::endl;
         std::cout << "FINAL CHOOSER CONTENTS" << std::endl;
         for (size_t i = 0; i < chooser_table_.size(); ++i) {
-            std::cout << std::to_string(i) << "\t" << chooser_table_[i] << std::endl;
+            std::cout << std::to_string(i) << "\t" << chooser_table_.get(i) << std::endl;
         }
-        gshare_.print_content();
-        bimodal_.print_content();
+        first_.print_content();
+        second_.print_content();
     }
 
 private:
     int k_;
 
     // using a chooser table of 2^k 2-bit counters. All counters are initialized to 01.
-    std::vector<int> chooser_table_;
+    CounterTable<2> chooser_table_;
 
-    Gshare gshare_;
-    Gshare bimodal_;
+    // gshare and bimodal in the assignment
+    First first_;
+    Second second_;
 
-    int predictions_;
-    int mispredictions_;
+    uint64_t predictions_;
+    uint64_t mispredictions_;
+};
+
+// the gshare / bimodal hybrid
+class Hybrid : public BasicHybrid<Gshare, Gshare> {
+public:
+    Hybrid(int k, int m1, int n, int m2) : BasicHybrid(k, Gshare(m1, n), Gshare(m2, 0)) {}
 };
 
 
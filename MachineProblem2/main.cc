@@ -1,12 +1,21 @@
+#include <cctype>
 #include <iostream>
 #include <string>
 #include <getopt.h>
 #include <format>
-#include <fstream>
 #include <sstream>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "trace_reader.h"
+#include "sampling.h"
+#include "checkpoint.h"
 #include "smith.h"
 #include "gshare.h"
 #include "hybrid.h"
+#include "tage.h"
+#include "perceptron.h"
+#include "batch.h"
 
 namespace {
 
@@ -15,26 +24,204 @@ void usage(const std::string& program_name) {
         << program_name << " smith <B> <tracefile>" << std::endl << 
         program_name << " bimodal <M2> <tracefile>" << std::endl <<
         program_name << " gshare <M1> <N> <tracefile>" << std::endl <<
-        program_name << " hybrid <K> <M1> <N> <M2> <tracefile>" << std::endl;
+        program_name << " hybrid <K> <M1> <N> <M2> <tracefile>" << std::endl <<
+        program_name << " tage <M> <T> <L1> <LT> <tracefile>" << std::endl <<
+        program_name << " perceptron <M> <H> <tracefile>" << std::endl <<
+        program_name << " hybrid <K> <component> <component> <tracefile>" << std::endl <<
+        "  a component is bimodal <M2>, gshare <M1> <N>, tage <M> <T> <L1> <LT> or perceptron <M> <H>" << std::endl <<
+        program_name << " [-g <grid>]... [-s <grid_file>] <tracefile>" << std::endl <<
+        "  batch mode, every config of the grids in one pass, one CSV row each. A grid is a predictor and" << std::endl <<
+        "  its fields, each a list of values or lo:hi ranges, e.g. -g \"gshare 8:16 0:8\"" << std::endl <<
+        "  --sample <period>,<window>[,<warmup>]  estimate the misprediction rate from the last window" << std::endl <<
+        "      branches of every period, after warmup branches of warming (default the rest of the period)" << std::endl <<
+        "  --save <N>,<file>  write the predictor state after N branches, --restore <file> goes on from it" << std::endl;
+}
+
+// the --sample, --save and --restore options
+struct RunOptions {
+    SamplingPlan sample_plan;
+    CheckpointOptions checkpoint;
+};
+
+// write the state of predictor once it has seen records branches, tagged with its name
+template <typename Predictor>
+void save_checkpoint(const std::string &path, uint64_t records, const std::string &name, const Predictor &predictor) {
+    CheckpointWriter out(CHECKPOINT_PREDICTOR, records);
+    out.put(std::vector<char>(name.begin(), name.end()));
+    predictor.save(out);
+    if (!out.save(path)) {
+        std::cerr << "Can't write checkpoint " << path << std::endl;
+        exit(1);
+    }
+}
+
+// load the state written by save_checkpoint, return the branches it has seen
+template <typename Predictor>
+uint64_t restore_checkpoint(const std::string &path, const std::string &name, Predictor &predictor) {
+    CheckpointReader in(path, CHECKPOINT_PREDICTOR);
+    std::vector<char> saved_name(name.size());
+    if (!in.get(saved_name) || std::string(saved_name.begin(), saved_name.end()) != name || !predictor.load(in) ||
+        !in.at_end()) {
+        std::cerr << "Invalid checkpoint for this predictor: " << path << std::endl;
+        exit(1);
+    }
+    return in.records();
+}
+
+// Read the trace file, hand every branch to predict and print the summary of predictor.
+// With a sampling plan only the windows are measured, and the summary is the estimated rate.
+// name tags the checkpoints of predictor
+template <typename Predictor, typename Predict>
+void run_trace(const std::string &trace_file, const RunOptions &options, const std::string &name, Predictor &predictor,
+    Predict predict) {
+    const SamplingPlan &plan = options.sample_plan;
+    const CheckpointOptions &checkpoint = options.checkpoint;
+    if (!checkpoint.save_path.empty() && plan.period != 0) {
+        std::cerr << "Save a checkpoint from a full run, sampled runs can restore one!" << std::endl;
+        exit(1);
+    }
+    TraceReader reader(trace_file);
+    if (!reader.is_open()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    // a restored run goes on from where the saved one stopped
+    uint64_t start = 0;
+    if (!checkpoint.restore_path.empty()) {
+        start = restore_checkpoint(checkpoint.restore_path, name, predictor);
+        if (reader.skip(start) != start) {
+            std::cerr << "The checkpoint is past the end of the trace!" << std::endl;
+            exit(1);
+        }
+    }
+    if (plan.period == 0) {
+        uint64_t position = start;
+        std::vector<BranchRecord> batch(TraceReader::kBatchSize);
+        while (size_t count = reader.read_branches(batch.data(), batch.size())) {
+            for (size_t i = 0; i < count; ++i) {
+                predict(batch[i]);
+                if (++position == checkpoint.save_at && !checkpoint.save_path.empty()) {
+                    save_checkpoint(checkpoint.save_path, position, name, predictor);
+                }
+            }
+        }
+        if (reader.failed()) {
+            std::cerr << "Invalid trace file!" << std::endl;
+            exit(1);
+        }
+        if (!checkpoint.save_path.empty() && (checkpoint.save_at <= start || checkpoint.save_at > position)) {
+            std::cerr << "No branch " << checkpoint.save_at << " to checkpoint after!" << std::endl;
+            exit(1);
+        }
+        predictor.print_summary();
+        return;
+    }
+
+    RatioEstimate rate;
+    uint64_t predictions = 0;
+    uint64_t mispredictions = 0;
+    uint64_t simulated = 0;
+    uint64_t total = start + run_sampled<BranchRecord>(reader, plan,
+        [&](const BranchRecord &record) {
+            ++simulated;
+            predict(record);
+        },
+        [&]() {
+            predictions = predictor.get_predictions();
+            mispredictions = predictor.get_mispredictions();
+        },
+        [&]() {
+            rate.add(predictor.get_mispredictions() - mispredictions, predictor.get_predictions() - predictions);
+        });
+    if (reader.failed()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    std::cout << "OUTPUT" << std::endl;
+    std::cout << "number of windows:\t\t" << rate.samples() << std::endl;
+    std::cout << "simulated branches:\t\t" << simulated << " of " << total << std::endl;
+    std::cout << "misprediction rate:\t\t" << std::format("{:.2f}% +- {:.2f}% (95% confidence)", rate.ratio() * 100,
+        rate.half_width() * 100) << std::endl;
+}
+
+// a component of a hybrid
+using Component = std::variant<Gshare, Tage, Perceptron>;
+
+// Parse a component from argv[i] on, leave i after it. name gets its predictor name.
+// Return false if argv doesn't start with one.
+bool parse_component(char *argv[], int argc, int &i, Component &component, std::string &name) {
+    if (i >= argc) {
+        return false;
+    }
+    name = argv[i];
+    auto fields = [&](int count) {
+        if (i + count >= argc) {
+            return false;
+        }
+        i += count + 1;
+        return true;
+    };
+    if (name == "bimodal" && fields(1)) {
+        component.emplace<Gshare>(std::stoi(argv[i - 1]), 0);
+    } else if (name == "gshare" && fields(2)) {
+        component.emplace<Gshare>(std::stoi(argv[i - 2]), std::stoi(argv[i - 1]));
+    } else if (name == "tage" && fields(4)) {
+        component.emplace<Tage>(std::stoi(argv[i - 4]), std::stoi(argv[i - 3]), std::stoi(argv[i - 2]),
+            std::stoi(argv[i - 1]));
+    } else if (name == "perceptron" && fields(2)) {
+        component.emplace<Perceptron>(std::stoi(argv[i - 2]), std::stoi(argv[i - 1]));
+    } else {
+        return false;
+    }
+    return true;
 }
 
 } // namespace
 
 
 int main(int argc, char *argv[]) {
-    
-    std::stringstream ss;
-    ss << "COMMAND" << std::endl;
-    for (int i = 0; i < argc; ++i) {
-        ss << argv[i] << " ";
-    }
-    ss.seekp(-1, std::ios_base::end);
-    ss << std::endl;
-    std::cout << ss.str();
-    
+
     int opt;
-    while ((opt = getopt(argc, argv, "h")) != -1) {
+    RunOptions options;
+    std::vector<PredictorConfig> batch_configs;
+    bool batch = false;
+    static const option long_options[] = {
+        {"sample", required_argument, nullptr, 'a'},
+        {"save", required_argument, nullptr, 'k'},
+        {"restore", required_argument, nullptr, 'e'},
+        {nullptr, 0, nullptr, 0},
+    };
+    while ((opt = getopt_long(argc, argv, "hg:s:", long_options, nullptr)) != -1) {
         switch (opt) {
+            case 'g':
+                batch = true;
+                if (!parse_predictor_grid(optarg, batch_configs)) {
+                    std::cerr << "Invalid predictor grid: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case 's':
+                batch = true;
+                if (!read_predictor_grid_file(optarg, batch_configs)) {
+                    std::cerr << "Invalid grid file!" << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'a':
+                if (!parse_sampling_plan(optarg, options.sample_plan)) {
+                    std::cerr << "Invalid sampling plan: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'k':
+                if (!parse_checkpoint_save(optarg, options.checkpoint)) {
+                    std::cerr << "Invalid checkpoint: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'e':
+                options.checkpoint.restore_path = optarg;
+                break;
             case 'h':
                 usage(argv[0]);
                 exit(0);
@@ -43,6 +230,25 @@ int main(int argc, char *argv[]) {
                 exit(1);
         }
     }
+    if (batch) {
+        if (argc - optind != 1) {
+            std::cerr << "Batch mode takes only the trace file!" << std::endl;
+            usage(argv[0]);
+            exit(1);
+        }
+        run_batch(batch_configs, argv[optind], std::cout);
+        return 0;
+    }
+
+    std::stringstream ss;
+    ss << "COMMAND" << std::endl;
+    for (int i = 0; i < argc; ++i) {
+        ss << argv[i] << " ";
+    }
+    ss.seekp(-1, std::ios_base::end);
+    ss << std::endl;
+    std::cout << ss.str();
+
     if (optind + 3 > argc) {
         std::cerr << "Argument count must >= 3!" << std::endl;
         usage(argv[0]);
@@ -55,27 +261,9 @@ int main(int argc, char *argv[]) {
         std::string trace_file(argv[optind + 2]);
 
         SmithPredictor smith_predictor(counter_bits);
-
-        // Read the trace file, and start the simulation
-        std::ifstream infile(trace_file);
-        if (!infile.is_open()) {
-            std::cerr << "Invalid trace file!" << std::endl;
-            exit(1);
-        }
-        std::string line;
-        while (std::getline(infile, line)) {
-            std::istringstream iss(line);
-            std::string address;
-            std::string ground_truth;
-            if (!(iss >> address >> ground_truth)) { 
-                std::cerr << "Invalid trace file!" << std::endl;
-                exit(1);
-                break;
-            }
-            smith_predictor.predict(ground_truth == "t");
-        }
-
-        smith_predictor.print_summary();
+        run_trace(trace_file, options, predictor, smith_predictor, [&](const BranchRecord &record) {
+            smith_predictor.predict(record.taken);
+        });
 
 
     } else if (predictor == "bimodal") {
@@ -84,25 +272,9 @@ int main(int argc, char *argv[]) {
 
         Gshare gshare(pc_bits, 0);
 
-        std::ifstream infile(tracefile);
-        if (!infile.is_open()) {
-            std::cerr << "Invalid trace file!" << std::endl;
-            exit(1);
-        }
-        std::string line;
-        while (std::getline(infile, line)) {
-            std::istringstream iss(line);
-            std::string address;
-            std::string ground_truth;
-            if (!(iss >> address >> ground_truth)) { 
-                std::cerr << "Invalid trace file!" << std::endl;
-                exit(1);
-                break;
-            }
-            gshare.predict(address, ground_truth == "t");
-        }
-
-        gshare.print_summary();
+        run_trace(tracefile, options, predictor, gshare, [&](const BranchRecord &record) {
+            gshare.predict(record.pc, record.taken);
+        });
 
     } else if (predictor == "gshare") {
         int pc_bits = std::stoi(argv[optind + 1]);
@@ -112,26 +284,67 @@ int main(int argc, char *argv[]) {
 
         Gshare gshare(pc_bits, history_bits);
 
-        std::ifstream infile(tracefile);
-        if (!infile.is_open()) {
-            std::cerr << "Invalid trace file!" << std::endl;
+        run_trace(tracefile, options, predictor, gshare, [&](const BranchRecord &record) {
+            gshare.predict(record.pc, record.taken);
+        });
+
+
+    } else if (predictor == "tage") {
+        if (optind + 5 >= argc) {
+            std::cerr << "tage takes <M> <T> <L1> <LT> <tracefile>!" << std::endl;
             exit(1);
         }
-        std::string line;
-        while (std::getline(infile, line)) {
-            std::istringstream iss(line);
-            std::string address;
-            std::string ground_truth;
-            if (!(iss >> address >> ground_truth)) { 
-                std::cerr << "Invalid trace file!" << std::endl;
-                exit(1);
-                break;
-            }
-            gshare.predict(address, ground_truth == "t");
+        int pc_bits = std::stoi(argv[optind + 1]);
+        int tables = std::stoi(argv[optind + 2]);
+        int min_history = std::stoi(argv[optind + 3]);
+        int max_history = std::stoi(argv[optind + 4]);
+        std::string tracefile(argv[optind + 5]);
+
+        Tage tage(pc_bits, tables, min_history, max_history);
+
+        run_trace(tracefile, options, predictor, tage, [&](const BranchRecord &record) {
+            tage.predict(record.pc, record.taken);
+        });
+
+    } else if (predictor == "perceptron") {
+        if (optind + 3 >= argc) {
+            std::cerr << "perceptron takes <M> <H> <tracefile>!" << std::endl;
+            exit(1);
         }
+        int pc_bits = std::stoi(argv[optind + 1]);
+        int history_bits = std::stoi(argv[optind + 2]);
+        std::string tracefile(argv[optind + 3]);
 
-        gshare.print_summary();
+        Perceptron perceptron(pc_bits, history_bits);
 
+        run_trace(tracefile, options, predictor, perceptron, [&](const BranchRecord &record) {
+            perceptron.predict(record.pc, record.taken);
+        });
+
+    } else if (predictor == "hybrid" && !std::isdigit(argv[optind + 2][0])) {
+        // hybrid of any two components
+        int k = std::stoi(argv[optind + 1]);
+        int i = optind + 2;
+        Component first = Gshare(0, 0);
+        Component second = Gshare(0, 0);
+        std::string first_name, second_name;
+        if (!parse_component(argv, argc, i, first, first_name) || !parse_component(argv, argc, i, second, second_name) ||
+            i + 1 != argc) {
+            std::cerr << "Invalid hybrid components!" << std::endl;
+            usage(argv[0]);
+            exit(1);
+        }
+        std::string tracefile(argv[i]);
+        std::string name = predictor + " " + first_name + " " + second_name;
+
+        std::visit([&](auto &first_component, auto &second_component) {
+            using First = std::decay_t<decltype(first_component)>;
+            using Second = std::decay_t<decltype(second_component)>;
+            BasicHybrid<First, Second> hybrid(k, std::move(first_component), std::move(second_component));
+            run_trace(tracefile, options, name, hybrid, [&](const BranchRecord &record) {
+                hybrid.predict(record.pc, record.taken);
+            });
+        }, first, second);
 
     } else if (predictor == "hybrid") {
         // the number of PC bits used to index the chooser table
@@ -145,27 +358,11 @@ int main(int argc, char *argv[]) {
         int m2 = std::stoi(argv[optind + 4]);
 
         std::string tracefile(argv[optind + 5]);
-        std::ifstream infile(tracefile);
-        if (!infile.is_open()) {
-            std::cerr << "Invalid trace file!" << std::endl;
-            exit(1);
-        }
         Hybrid hybrid(k, pc_bits, history_bits, m2);
 
-        std::string line;
-        while (std::getline(infile, line)) {
-            std::istringstream iss(line);
-            std::string address;
-            std::string ground_truth;
-            if (!(iss >> address >> ground_truth)) { 
-                std::cerr << "Invalid trace file!" << std::endl;
-                exit(1);
-                break;
-            }
-            hybrid.predict(address, ground_truth == "t");
-        }
-
-        hybrid.print_summary();
+        run_trace(tracefile, options, predictor, hybrid, [&](const BranchRecord &record) {
+            hybrid.predict(record.pc, record.taken);
+        });
 
     } else {
         std::cerr << "Invalid predictor type!" << std::endl;
@@ -0,0 +1,158 @@
+#ifndef PERCEPTRON_H
+#define PERCEPTRON_H
+
+#include "checkpoint.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Perceptron predictor (Jimenez and Lin): 2^m rows, picked by a hash of the pc, of h + 1 8-bit
+// weights. The output is the bias weight plus the dot product of the other weights with the
+// global history as +1 / -1, taken if >= 0. Trained on a mispredict or an output within the
+// threshold 1.93 h + 14.
+class Perceptron {
+public:
+    Perceptron(int m, int h)
+        : m_(m), h_(h), threshold_(int(1.93 * h + 14)), predictions_(0), mispredictions_(0) {
+
+        if (m < 0 || m > kMaxRowBits || h < 1 || h > kMaxHistory) {
+            std::cerr << "perceptron needs 0 <= m <= " << kMaxRowBits << " and 1 <= h <= " << kMaxHistory << "!"
+                << std::endl;
+            exit(1);
+        }
+        weights_.assign((size_t(1) << m) * row_size(h), 0);
+        history_.assign(2 * size_t(h), -1);
+    }
+
+    // if predict wrong, return false
+    bool predict(uint64_t pc, bool taken) {
+        bool predict_taken = predict_only(pc);
+        update_only(taken, predict_taken, pc);
+        return predict_taken == taken;
+    }
+
+    // return predict result, true if taken
+    bool predict_only(uint64_t pc) {
+        return output(row(pc)) >= 0;
+    }
+
+    void update_only(bool taken, bool predict_taken, uint64_t pc) {
+        ++predictions_;
+        if (predict_taken != taken) {
+            ++mispredictions_;
+        }
+
+        int8_t *weights = row(pc);
+        int y = output(weights);
+        if ((y >= 0) != taken || std::abs(y) <= threshold_) {
+            train(weights, taken);
+        }
+
+        update_history(taken);
+    }
+
+    uint64_t get_predictions() const {
+        return predictions_;
+    }
+    uint64_t get_mispredictions() const {
+        return mispredictions_;
+    }
+
+    // the global history must see every branch, even if the perceptron did not predict it
+    void update_history(bool taken) {
+        // the history is kept twice, so the newest h outcomes are always contiguous from head_
+        head_ = head_ == 0 ? h_ - 1 : head_ - 1;
+        history_[head_] = history_[head_ + h_] = taken ? 1 : -1;
+    }
+
+    void save(CheckpointWriter &out) const {
+        out.put(m_);
+        out.put(h_);
+        out.put(weights_);
+        out.put(history_);
+        out.put(head_);
+        out.put(predictions_);
+        out.put(mispredictions_);
+    }
+
+    // false if the checkpoint is of another predictor
+    bool load(CheckpointReader &in) {
+        return in.expect(m_) && in.expect(h_) && in.get(weights_) && in.get(history_) && in.get(head_) &&
+            head_ < size_t(h_) && in.get(predictions_) && in.get(mispredictions_);
+    }
+
+    void print_summary() {
+        std::cout << "OUTPUT" << std::endl;
+        std::cout << "number of predictions:\t\t" << predictions_ << std::endl;
+        std::cout << "number of mispredictions:\t" << mispredictions_ << std::endl;
+        std::cout << "misprediction rate:\t\t" << std::format("{:.2f}%", (double)mispredictions_ / predictions_ * 100) << std::endl;
+        print_content();
+    }
+    // the bias weight of every row
+    void print_content() {
+        std::cout << "FINAL PERCEPTRON CONTENTS" << std::endl;
+        for (size_t i = 0; i < weights_.size() / row_size(h_); ++i) {
+            std::cout << std::to_string(i) << "\t" << int(weights_[i * row_size(h_)]) << std::endl;
+        }
+    }
+
+private:
+    static constexpr int kMaxRowBits = 24;
+    static constexpr int kMaxHistory = 1024;
+    static constexpr int kMaxWeight = 127;
+
+    // the bias and h history weights, rows padded to a multiple of 16 bytes
+    static size_t row_size(int h) {
+        return (size_t(h) + 1 + 15) & ~size_t(15);
+    }
+
+    int8_t *row(uint64_t pc) {
+        uint64_t address = pc >> 2;
+        size_t index = (address ^ (address >> m_)) & ((size_t(1) << m_) - 1);
+        return weights_.data() + index * row_size(h_);
+    }
+
+    // Bias plus the dot product of 8-bit weights and +1 / -1 history, a plain loop over two
+    // contiguous int8 arrays that -O3 turns into SIMD multiply-adds.
+    int output(const int8_t *weights) const {
+        const int8_t *x = history_.data() + head_;
+        const int8_t *w = weights + 1;
+        int y = weights[0];
+        for (int i = 0; i < h_; ++i) {
+            y += w[i] * x[i];
+        }
+        return y;
+    }
+
+    // move every weight towards the outcome, or its inverse for the not taken history bits
+    void train(int8_t *weights, bool taken) {
+        int t = taken ? 1 : -1;
+        weights[0] = std::clamp(weights[0] + t, -kMaxWeight, kMaxWeight);
+        const int8_t *x = history_.data() + head_;
+        int8_t *w = weights + 1;
+        // a local bound, the int8 stores could alias h_
+        int h = h_;
+        for (int i = 0; i < h; ++i) {
+            int weight = w[i] + t * x[i];
+            w[i] = std::min(std::max(weight, -kMaxWeight), kMaxWeight);
+        }
+    }
+
+    int m_;
+    int h_;
+    int threshold_;
+
+    std::vector<int8_t> weights_;
+    // +1 taken, -1 not taken, newest first from head_
+    std::vector<int8_t> history_;
+    size_t head_ = 0;
+
+    uint64_t predictions_;
+    uint64_t mispredictions_;
+};
+
+#endif // PERCEPTRON_H
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <format>
+#include "checkpoint.h"
 
 class SmithPredictor {
 public:
@@ -51,10 +52,30 @@ public:
         }
     }
 
+    uint64_t get_predictions() const {
+        return predictions_;
+    }
+    uint64_t get_mispredictions() const {
+        return mispredictions_;
+    }
+
     int content() const {
         return content_;
     }
 
+    void save(CheckpointWriter &out) const {
+        out.put(counter_bits_);
+        out.put(content_);
+        out.put(predictions_);
+        out.put(mispredictions_);
+    }
+
+    // false if the checkpoint is of another predictor
+    bool load(CheckpointReader &in) {
+        return in.expect(counter_bits_) && in.get(content_) && in.get(predictions_) && in.get(mispredictions_) &&
+            content_ >= 0 && content_ <= max_value_;
+    }
+
     void print_summary() {
         std::cout << "OUTPUT" << std::endl;
         std::cout << "number of predictions:\t\t" << predictions_ << std::endl;
@@ -67,8 +88,8 @@ private:
     int counter_bits_;
     int content_;
     int max_value_;
-    int predictions_;
-    int mispredictions_;
+    uint64_t predictions_;
+    uint64_t mispredictions_;
 };
 
 #endif // SMITH_H
\ No newline at end of file
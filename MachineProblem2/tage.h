@@ -0,0 +1,333 @@
+#ifndef TAGE_H
+#define TAGE_H
+
+#include "counter_table.h"
+#include "checkpoint.h"
+#include "folded_history.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// TAGE: a bimodal base table of 2^m 2-bit counters and t tagged tables of 2^(m-1) entries,
+// indexed by the pc hashed with global histories of geometric lengths l1 ... lt.
+// The longest history whose tag matches provides the prediction, a mispredict allocates an
+// entry in a longer table. Histories are folded into the index and tag widths incrementally.
+class Tage {
+public:
+    Tage(int m, int t, int l1, int lt)
+        : m_(checked_m(m, t, l1, lt)), t_(t), l1_(l1), lt_(lt), log_tagged_(m - 1),
+          base_(size_t(1) << m, kInitialBase), history_(lt), predictions_(0), mispredictions_(0) {
+
+        for (int i = 0; i < t; ++i) {
+            // geometric series from l1 to lt
+            int length = t == 1 ? lt : int(l1 * std::pow(double(lt) / l1, double(i) / (t - 1)) + 0.5);
+            int tag_bits = std::min(kMinTagBits + i, kMaxTagBits);
+            tables_.push_back({length, tag_bits, FoldedHistory(length, log_tagged_), FoldedHistory(length, tag_bits),
+                FoldedHistory(length, tag_bits - 1), std::vector<Entry>(size_t(1) << log_tagged_)});
+        }
+    }
+
+    // if predict wrong, return false
+    bool predict(uint64_t pc, bool taken) {
+        bool predict_taken = predict_only(pc);
+        update_only(taken, predict_taken, pc);
+        return predict_taken == taken;
+    }
+
+    // return predict result, true if taken. The lookup is kept for the update_only of the same branch
+    bool predict_only(uint64_t pc) {
+        last_ = lookup(pc);
+        last_pc_ = pc;
+        has_last_ = true;
+        return last_.prediction;
+    }
+
+    void update_only(bool taken, bool predict_taken, uint64_t pc) {
+        ++predictions_;
+        if (predict_taken != taken) {
+            ++mispredictions_;
+        }
+
+        // nothing changes the tables or the histories between predict_only and update_only
+        if (!has_last_ || last_pc_ != pc) {
+            last_ = lookup(pc);
+        }
+        has_last_ = false;
+        const Lookup &found = last_;
+        if (found.provider >= 0) {
+            Entry &entry = tables_[found.provider].entries[found.index[found.provider]];
+            bool provider_taken = entry.counter >= 0;
+            // learn whether a newly allocated (weak) entry beats the alternate prediction
+            if (weak(entry) && provider_taken != found.alternate) {
+                use_alternate_ = saturate(use_alternate_ + (found.alternate == taken ? 1 : -1), -8, 7);
+            }
+            if (provider_taken != found.alternate) {
+                entry.useful = saturate(entry.useful + (provider_taken == taken ? 1 : -1), 0, kMaxUseful);
+            }
+            entry.counter = saturate(entry.counter + (taken ? 1 : -1), -4, 3);
+        } else {
+            base_.update(found.base_index, taken);
+        }
+
+        // a mispredict takes an entry in a longer table, the first one not useful
+        if (found.prediction != taken && found.provider < t_ - 1) {
+            bool allocated = false;
+            for (int i = found.provider + 1; i < t_ && !allocated; ++i) {
+                Entry &entry = tables_[i].entries[found.index[i]];
+                if (entry.useful == 0) {
+                    entry = {int8_t(taken ? 0 : -1), uint16_t(found.tag[i]), 0, true};
+                    allocated = true;
+                }
+            }
+            if (!allocated) {
+                for (int i = found.provider + 1; i < t_; ++i) {
+                    Entry &entry = tables_[i].entries[found.index[i]];
+                    entry.useful -= entry.useful > 0;
+                }
+            }
+        }
+
+        // age the useful counters so that stale entries can be replaced
+        if (++branches_ % kUsefulPeriod == 0) {
+            for (Table &table : tables_) {
+                for (Entry &entry : table.entries) {
+                    entry.useful >>= 1;
+                }
+            }
+        }
+
+        update_history(taken);
+    }
+
+    uint64_t get_predictions() const {
+        return predictions_;
+    }
+    uint64_t get_mispredictions() const {
+        return mispredictions_;
+    }
+
+    // the global history must see every branch, even if TAGE did not predict it
+    void update_history(bool taken) {
+        has_last_ = false;
+        history_.push(taken);
+        for (Table &table : tables_) {
+            table.index_history.update(history_);
+            table.tag_history.update(history_);
+            table.tag_history2.update(history_);
+        }
+    }
+
+    void save(CheckpointWriter &out) const {
+        out.put(m_);
+        out.put(t_);
+        out.put(l1_);
+        out.put(lt_);
+        std::vector<uint8_t> base(base_.size());
+        for (size_t i = 0; i < base_.size(); ++i) {
+            base[i] = base_.get(i);
+        }
+        out.put(base);
+        for (const Table &table : tables_) {
+            // field by field, so a load can check every value
+            std::vector<int8_t> counters(table.entries.size());
+            std::vector<uint16_t> tags(table.entries.size());
+            std::vector<uint8_t> useful(table.entries.size());
+            std::vector<uint8_t> valid(table.entries.size());
+            for (size_t i = 0; i < table.entries.size(); ++i) {
+                counters[i] = table.entries[i].counter;
+                tags[i] = table.entries[i].tag;
+                useful[i] = table.entries[i].useful;
+                valid[i] = table.entries[i].valid;
+            }
+            out.put(counters);
+            out.put(tags);
+            out.put(useful);
+            out.put(valid);
+            out.put(table.index_history.value);
+            out.put(table.tag_history.value);
+            out.put(table.tag_history2.value);
+        }
+        out.put(history_.bits());
+        out.put(history_.head());
+        out.put(use_alternate_);
+        out.put(branches_);
+        out.put(predictions_);
+        out.put(mispredictions_);
+    }
+
+    // false if the checkpoint is of another predictor
+    bool load(CheckpointReader &in) {
+        std::vector<uint8_t> base(base_.size());
+        if (!(in.expect(m_) && in.expect(t_) && in.expect(l1_) && in.expect(lt_) && in.get(base))) {
+            return false;
+        }
+        for (size_t i = 0; i < base_.size(); ++i) {
+            if (base[i] > CounterTable<2>::kMax) {
+                return false;
+            }
+            base_.set(i, base[i]);
+        }
+        for (Table &table : tables_) {
+            std::vector<int8_t> counters(table.entries.size());
+            std::vector<uint16_t> tags(table.entries.size());
+            std::vector<uint8_t> useful(table.entries.size());
+            std::vector<uint8_t> valid(table.entries.size());
+            if (!(in.get(counters) && in.get(tags) && in.get(useful) && in.get(valid) &&
+                in.get(table.index_history.value) && in.get(table.tag_history.value) &&
+                in.get(table.tag_history2.value))) {
+                return false;
+            }
+            for (size_t i = 0; i < table.entries.size(); ++i) {
+                if (counters[i] < -4 || counters[i] > 3 || tags[i] >> table.tag_bits != 0 || useful[i] > kMaxUseful ||
+                    valid[i] > 1) {
+                    return false;
+                }
+                table.entries[i] = {counters[i], tags[i], useful[i], valid[i] == 1};
+            }
+        }
+        has_last_ = false;
+        return in.get(history_.bits()) && in.get(history_.head()) && history_.head() < history_.bits().size() &&
+            in.get(use_alternate_) && in.get(branches_) && in.get(predictions_) && in.get(mispredictions_);
+    }
+
+    void print_summary() {
+        std::cout << "OUTPUT" << std::endl;
+        std::cout << "number of predictions:\t\t" << predictions_ << std::endl;
+        std::cout << "number of mispredictions:\t" << mispredictions_ << std::endl;
+        std::cout << "misprediction rate:\t\t" << std::format("{:.2f}%", (double)mispredictions_ / predictions_ * 100) << std::endl;
+        print_content();
+    }
+    // the history lengths and how many entries of each table are in use, then the base table
+    void print_content() {
+        std::cout << "FINAL TAGE CONTENTS" << std::endl;
+        for (int i = 0; i < t_; ++i) {
+            size_t used = 0;
+            for (const Entry &entry : tables_[i].entries) {
+                used += entry.valid;
+            }
+            std::cout << "T" << i + 1 << "\thistory " << tables_[i].length << "\ttag bits " << tables_[i].tag_bits
+                << "\tused " << used << " of " << tables_[i].entries.size() << std::endl;
+        }
+        std::cout << "FINAL TAGE BASE CONTENTS" << std::endl;
+        for (size_t i = 0; i < base_.size(); ++i) {
+            std::cout << std::to_string(i) << "\t" << base_.get(i) << std::endl;
+        }
+    }
+
+private:
+    static constexpr int kMaxRowBits = 24;
+    static constexpr int kMaxTables = 16;
+    static constexpr int kMaxHistory = 1024;
+    static constexpr int kMinTagBits = 8;
+    static constexpr int kMaxTagBits = 15;
+    static constexpr int kMaxUseful = 3;
+    static constexpr int kUsefulPeriod = 1 << 18;
+    // 2 bit base counters, starting at 2 (weakly taken)
+    static constexpr uint64_t kInitialBase = 2;
+
+    struct Entry {
+        // 3 bit signed counter, taken if >= 0
+        int8_t counter = 0;
+        uint16_t tag = 0;
+        uint8_t useful = 0;
+        // never allocated, so no tag matches it
+        bool valid = false;
+    };
+
+    struct Table {
+        int length;
+        int tag_bits;
+        FoldedHistory index_history;
+        FoldedHistory tag_history;
+        // a second fold one bit narrower, so that the tag is not the index history again
+        FoldedHistory tag_history2;
+        std::vector<Entry> entries;
+    };
+
+    struct Lookup {
+        uint32_t index[kMaxTables];
+        uint32_t tag[kMaxTables];
+        size_t base_index;
+        // longest table with a tag hit, -1 if none (the base table provides)
+        int provider = -1;
+        // prediction of the next longest hit, or the base table
+        bool alternate;
+        bool prediction;
+    };
+
+    // exit on parameters out of range, before any table is sized by them
+    static int checked_m(int m, int t, int l1, int lt) {
+        if (m < 2 || m > kMaxRowBits || t < 1 || t > kMaxTables || l1 < 1 || lt < l1 || lt > kMaxHistory) {
+            std::cerr << "tage needs 2 <= m <= " << kMaxRowBits << ", 1 <= t <= " << kMaxTables << ", 1 <= l1 <= lt <= "
+                << kMaxHistory << "!" << std::endl;
+            exit(1);
+        }
+        return m;
+    }
+
+    static int saturate(int value, int low, int high) {
+        return std::min(std::max(value, low), high);
+    }
+    static bool weak(const Entry &entry) {
+        return entry.counter == 0 || entry.counter == -1;
+    }
+
+    Lookup lookup(uint64_t pc) const {
+        Lookup found;
+        uint64_t address = pc >> 2;
+        found.base_index = address & (base_.size() - 1);
+        uint32_t index_mask = (uint32_t(1) << log_tagged_) - 1;
+        int alternate = -1;
+        for (int i = t_ - 1; i >= 0; --i) {
+            const Table &table = tables_[i];
+            found.index[i] = (address ^ (address >> (log_tagged_ - i % log_tagged_)) ^ table.index_history.value) &
+                index_mask;
+            found.tag[i] = (address ^ table.tag_history.value ^ (table.tag_history2.value << 1)) &
+                ((uint32_t(1) << table.tag_bits) - 1);
+            const Entry &entry = table.entries[found.index[i]];
+            if (entry.valid && entry.tag == found.tag[i] && alternate < 0) {
+                if (found.provider < 0) {
+                    found.provider = i;
+                } else {
+                    alternate = i;
+                }
+            }
+        }
+
+        bool base_taken = base_.predict(found.base_index);
+        found.alternate = alternate >= 0 ? tables_[alternate].entries[found.index[alternate]].counter >= 0 : base_taken;
+        if (found.provider < 0) {
+            found.prediction = base_taken;
+        } else {
+            const Entry &entry = tables_[found.provider].entries[found.index[found.provider]];
+            found.prediction = weak(entry) && use_alternate_ >= 0 ? found.alternate : entry.counter >= 0;
+        }
+        return found;
+    }
+
+    int m_;
+    int t_;
+    int l1_;
+    int lt_;
+    int log_tagged_;
+
+    CounterTable<2> base_;
+    std::vector<Table> tables_;
+    GlobalHistory history_;
+    // 4 bit signed, >= 0 when weak providers should defer to the alternate prediction
+    int use_alternate_ = 0;
+    uint64_t branches_ = 0;
+    // the lookup of the last predict_only, for its update_only
+    Lookup last_;
+    uint64_t last_pc_ = 0;
+    bool has_last_ = false;
+
+    uint64_t predictions_;
+    uint64_t mispredictions_;
+};
+
+#endif // TAGE_H
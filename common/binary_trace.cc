@@ -0,0 +1,131 @@
+#include "binary_trace.h"
+#include <cstring>
+#include <zlib.h>
+
+// the header and block sizes are written as they sit in memory, which is little endian on every host we use
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "binary traces are little endian");
+
+bool is_binary_trace(const char *data, size_t size) {
+    if (size < sizeof(TraceHeader)) {
+        return false;
+    }
+    TraceHeader header;
+    memcpy(&header, data, sizeof(header));
+    return memcmp(header.magic, kTraceMagic, sizeof(kTraceMagic)) == 0 && header.version == kTraceVersion;
+}
+
+void encode_trace_record(std::vector<uint8_t> &out, uint64_t &previous, uint64_t value, bool bit) {
+    int64_t delta = static_cast<int64_t>(value - previous);
+    uint64_t zigzag = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+    previous = value;
+
+    uint8_t first = (bit ? 1 : 0) | ((zigzag & 0x3f) << 1);
+    zigzag >>= 6;
+    if (zigzag == 0) {
+        out.push_back(first);
+        return;
+    }
+    out.push_back(first | 0x80);
+    while (zigzag >= 0x80) {
+        out.push_back((zigzag & 0x7f) | 0x80);
+        zigzag >>= 7;
+    }
+    out.push_back(zigzag);
+}
+
+bool decode_trace_record(const uint8_t *&p, const uint8_t *end, uint64_t &previous, uint64_t &value, bool &bit) {
+    if (p == end) {
+        return false;
+    }
+    uint8_t byte = *p++;
+    bit = byte & 1;
+    uint64_t zigzag = (byte >> 1) & 0x3f;
+    int shift = 6;
+    while (byte & 0x80) {
+        if (p == end || shift > 63) {
+            return false;
+        }
+        byte = *p++;
+        zigzag |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        shift += 7;
+    }
+    int64_t delta = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+    value = previous + static_cast<uint64_t>(delta);
+    previous = value;
+    return true;
+}
+
+BinaryTraceWriter::BinaryTraceWriter(const std::string &path, TraceKind kind, bool compress) {
+    memcpy(header_.magic, kTraceMagic, sizeof(kTraceMagic));
+    header_.version = kTraceVersion;
+    header_.kind = kind;
+    header_.flags = compress ? TRACE_COMPRESSED : 0;
+    header_.record_count = 0;
+    header_.block_records = kTraceBlockRecords;
+    header_.reserved = 0;
+
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+        return;
+    }
+    // the record count is filled in by close
+    if (fwrite(&header_, sizeof(header_), 1, file_) != 1) {
+        error_ = true;
+    }
+}
+
+BinaryTraceWriter::~BinaryTraceWriter() {
+    close();
+}
+
+bool BinaryTraceWriter::is_open() const {
+    return file_ != nullptr;
+}
+
+void BinaryTraceWriter::write(uint64_t value, bool bit) {
+    encode_trace_record(block_, previous_, value, bit);
+    ++header_.record_count;
+    if (++block_count_ == header_.block_records) {
+        flush_block();
+    }
+}
+
+void BinaryTraceWriter::flush_block() {
+    if (block_count_ == 0) {
+        return;
+    }
+    uint32_t sizes[2];
+    sizes[0] = block_.size();
+    const uint8_t *stored = block_.data();
+    sizes[1] = block_.size();
+    if (header_.flags & TRACE_COMPRESSED) {
+        uLongf compressed_size = compressBound(block_.size());
+        compressed_.resize(compressed_size);
+        if (compress2(compressed_.data(), &compressed_size, block_.data(), block_.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+            error_ = true;
+        }
+        stored = compressed_.data();
+        sizes[1] = compressed_size;
+    }
+    if (fwrite(sizes, sizeof(sizes), 1, file_) != 1 || fwrite(stored, 1, sizes[1], file_) != sizes[1]) {
+        error_ = true;
+    }
+    block_.clear();
+    block_count_ = 0;
+    previous_ = 0;
+}
+
+bool BinaryTraceWriter::close() {
+    if (file_ == nullptr) {
+        return !error_;
+    }
+    flush_block();
+    if (fseek(file_, 0, SEEK_SET) != 0 || fwrite(&header_, sizeof(header_), 1, file_) != 1) {
+        error_ = true;
+    }
+    if (fclose(file_) != 0) {
+        error_ = true;
+    }
+    file_ = nullptr;
+    return !error_;
+}
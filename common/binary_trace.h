@@ -0,0 +1,83 @@
+#ifndef BINARY_TRACE_H
+#define BINARY_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Binary trace format, version 1, all integers little endian
+//
+//   header  TraceHeader
+//   blocks  uint32 raw_size, uint32 stored_size, stored_size bytes
+//           (zlib compressed when TRACE_COMPRESSED is set, raw otherwise)
+//
+// A block holds up to block_records records. Each record is the delta of its value
+// (address or pc) to the previous record, zigzag encoded, plus one bit (write / taken):
+//   first byte    bit 0 = bit, bits 1-6 = low 6 bits of the delta, bit 7 = more bytes
+//   next bytes    LEB128 of the rest of the delta
+// The previous value restarts at 0 in every block, so blocks decode independently.
+
+enum TraceKind : uint8_t {
+    TRACE_MEMORY = 0,
+    TRACE_BRANCH = 1,
+};
+
+// header flags
+constexpr uint8_t TRACE_COMPRESSED = 1;
+
+constexpr char kTraceMagic[4] = {'C', 'T', 'R', 'C'};
+constexpr uint16_t kTraceVersion = 1;
+constexpr uint32_t kTraceBlockRecords = 1 << 16;
+// the first byte of a record holds 6 bits of its 64-bit delta, LEB128 the other 58 in up to 9 more
+constexpr size_t kMaxTraceRecordBytes = 10;
+
+struct TraceHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t kind;
+    uint8_t flags;
+    uint64_t record_count;
+    uint32_t block_records;
+    uint32_t reserved;
+};
+static_assert(sizeof(TraceHeader) == 24, "TraceHeader must be packed");
+
+// true if data starts with a binary trace header this build can read
+bool is_binary_trace(const char *data, size_t size);
+
+// append one record to out
+void encode_trace_record(std::vector<uint8_t> &out, uint64_t &previous, uint64_t value, bool bit);
+
+// decode one record at p, return false if it runs past end
+bool decode_trace_record(const uint8_t *&p, const uint8_t *end, uint64_t &previous, uint64_t &value, bool &bit);
+
+class BinaryTraceWriter {
+public:
+    BinaryTraceWriter(const std::string &path, TraceKind kind, bool compress);
+    ~BinaryTraceWriter();
+
+    BinaryTraceWriter(const BinaryTraceWriter &) = delete;
+    BinaryTraceWriter &operator=(const BinaryTraceWriter &) = delete;
+
+    bool is_open() const;
+
+    void write(uint64_t value, bool bit);
+
+    // flush the last block and the final record count, return false on an I/O error
+    bool close();
+
+private:
+    void flush_block();
+
+    FILE *file_ = nullptr;
+    TraceHeader header_;
+    std::vector<uint8_t> block_;
+    std::vector<uint8_t> compressed_;
+    uint32_t block_count_ = 0;
+    uint64_t previous_ = 0;
+    bool error_ = false;
+};
+
+#endif // BINARY_TRACE_H
@@ -0,0 +1,79 @@
+#include "checkpoint.h"
+#include <cstdio>
+#include <sstream>
+#include <zlib.h>
+
+namespace {
+
+// deflate expands nothing by more than about 1032:1, so a larger raw size is a corrupt header
+const uint64_t kMaxDeflateRatio = 1032;
+
+} // namespace
+
+bool parse_checkpoint_save(const std::string &spec, CheckpointOptions &options) {
+    std::istringstream iss(spec);
+    char comma;
+    if (!(iss >> options.save_at >> comma) || comma != ',' || !std::getline(iss, options.save_path)) {
+        return false;
+    }
+    return !options.save_path.empty();
+}
+
+CheckpointWriter::CheckpointWriter(CheckpointKind kind, uint64_t records) {
+    memcpy(header_.magic, kCheckpointMagic, sizeof(header_.magic));
+    header_.version = kCheckpointVersion;
+    header_.kind = kind;
+    header_.reserved = 0;
+    header_.records = records;
+    header_.raw_size = 0;
+    header_.stored_size = 0;
+}
+
+bool CheckpointWriter::save(const std::string &path) {
+    uLongf stored_size = compressBound(payload_.size());
+    std::vector<uint8_t> stored(stored_size);
+    if (compress(stored.data(), &stored_size, payload_.data(), payload_.size()) != Z_OK) {
+        return false;
+    }
+    header_.raw_size = payload_.size();
+    header_.stored_size = stored_size;
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(&header_, sizeof(header_), 1, file) == 1 && fwrite(stored.data(), 1, stored_size, file) == stored_size;
+    return fclose(file) == 0 && ok;
+}
+
+CheckpointReader::CheckpointReader(const std::string &path, CheckpointKind kind) {
+    failed_ = true;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return;
+    }
+    std::vector<uint8_t> stored;
+    bool ok = fread(&header_, sizeof(header_), 1, file) == 1 && memcmp(header_.magic, kCheckpointMagic, sizeof(header_.magic)) == 0 &&
+        header_.version == kCheckpointVersion && header_.kind == kind;
+    // check the sizes against the file before allocating for them, a truncated or corrupt file
+    // must not ask for more memory than it could hold
+    long file_size = -1;
+    if (ok && fseek(file, 0, SEEK_END) == 0) {
+        file_size = ftell(file);
+    }
+    ok = ok && file_size >= long(sizeof(header_)) && header_.stored_size == uint64_t(file_size) - sizeof(header_) &&
+        header_.raw_size <= header_.stored_size * kMaxDeflateRatio && fseek(file, sizeof(header_), SEEK_SET) == 0;
+    if (ok) {
+        stored.resize(header_.stored_size);
+        ok = fread(stored.data(), 1, stored.size(), file) == stored.size();
+    }
+    fclose(file);
+    if (!ok) {
+        return;
+    }
+    payload_.resize(header_.raw_size);
+    uLongf raw_size = payload_.size();
+    if (uncompress(payload_.data(), &raw_size, stored.data(), stored.size()) != Z_OK || raw_size != payload_.size()) {
+        return;
+    }
+    failed_ = false;
+}
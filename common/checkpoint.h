@@ -0,0 +1,130 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Checkpoint format, version 1, all integers little endian
+//
+//   header   CheckpointHeader
+//   payload  stored_size bytes, zlib compressed, raw_size bytes once uncompressed
+//
+// The payload is the state of every model of the run, in the order the simulator saves it.
+// Each model starts with its configuration, so a checkpoint only loads into the same setup.
+// records is the number of trace records the state has seen, a restored run skips them.
+
+enum CheckpointKind : uint8_t {
+    CHECKPOINT_CACHE = 0,
+    CHECKPOINT_PREDICTOR = 1,
+};
+
+constexpr char kCheckpointMagic[4] = {'C', 'K', 'P', 'T'};
+constexpr uint16_t kCheckpointVersion = 1;
+
+struct CheckpointHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t kind;
+    uint8_t reserved;
+    uint64_t records;
+    uint64_t raw_size;
+    uint64_t stored_size;
+};
+static_assert(sizeof(CheckpointHeader) == 32, "CheckpointHeader must be packed");
+
+// --save <N>,<file> and --restore <file> of sim_cache and sim
+struct CheckpointOptions {
+    // save after save_at records when save_path is set
+    std::string save_path;
+    uint64_t save_at = 0;
+    std::string restore_path;
+};
+
+// "<N>,<file>", return false if the spec is invalid
+bool parse_checkpoint_save(const std::string &spec, CheckpointOptions &options);
+
+// Collects the state in memory, save() writes it compressed
+class CheckpointWriter {
+public:
+    CheckpointWriter(CheckpointKind kind, uint64_t records);
+
+    template <typename T>
+    void put(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+        payload_.insert(payload_.end(), bytes, bytes + sizeof(T));
+    }
+    // the size, then the elements
+    template <typename T>
+    void put(const std::vector<T> &values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        put<uint64_t>(values.size());
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(values.data());
+        payload_.insert(payload_.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    // return false on an I/O error
+    bool save(const std::string &path);
+
+private:
+    CheckpointHeader header_;
+    std::vector<uint8_t> payload_;
+};
+
+// Reads a whole checkpoint, every get returns false once the payload doesn't match
+class CheckpointReader {
+public:
+    CheckpointReader(const std::string &path, CheckpointKind kind);
+
+    // the file is missing, not a checkpoint of kind, or a get went past its end
+    bool failed() const { return failed_; }
+    uint64_t records() const { return header_.records; }
+    // every byte of the payload was read
+    bool at_end() const { return !failed_ && pos_ == payload_.size(); }
+
+    template <typename T>
+    bool get(T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (failed_ || payload_.size() - pos_ < sizeof(T)) {
+            failed_ = true;
+            return false;
+        }
+        memcpy(&value, payload_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return true;
+    }
+    // values must already have the saved size, the state arrays are sized by the configuration
+    template <typename T>
+    bool get(std::vector<T> &values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint64_t size;
+        if (!get(size) || size != values.size() || (payload_.size() - pos_) / sizeof(T) < size) {
+            failed_ = true;
+            return false;
+        }
+        memcpy(values.data(), payload_.data() + pos_, size * sizeof(T));
+        pos_ += size * sizeof(T);
+        return true;
+    }
+    // a saved configuration value must equal the one of this run
+    template <typename T>
+    bool expect(const T &value) {
+        T saved;
+        if (!get(saved) || saved != value) {
+            failed_ = true;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    CheckpointHeader header_{};
+    std::vector<uint8_t> payload_;
+    size_t pos_ = 0;
+    bool failed_ = false;
+};
+
+#endif // CHECKPOINT_H
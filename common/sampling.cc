@@ -0,0 +1,42 @@
+#include "sampling.h"
+#include <cmath>
+#include <sstream>
+
+bool parse_sampling_plan(const std::string &spec, SamplingPlan &plan) {
+    std::istringstream iss(spec);
+    char comma1, comma2;
+    if (!(iss >> plan.period >> comma1 >> plan.window) || comma1 != ',') {
+        return false;
+    }
+    if (iss.eof()) {
+        plan.warmup = plan.period - std::min(plan.window, plan.period);
+    } else if (!(iss >> comma2 >> plan.warmup) || comma2 != ',' || !iss.eof()) {
+        return false;
+    }
+    return plan.window > 0 && plan.window + plan.warmup <= plan.period;
+}
+
+void RatioEstimate::add(double numerator, double denominator) {
+    ++samples_;
+    sum_n_ += numerator;
+    sum_d_ += denominator;
+    sum_nn_ += numerator * numerator;
+    sum_dd_ += denominator * denominator;
+    sum_nd_ += numerator * denominator;
+}
+
+double RatioEstimate::ratio() const {
+    return sum_d_ == 0 ? 0 : sum_n_ / sum_d_;
+}
+
+double RatioEstimate::half_width() const {
+    if (samples_ < 2 || sum_d_ == 0) {
+        return 0;
+    }
+    // variance of the residuals n - r * d over the windows, then of r
+    double r = ratio();
+    double residuals = (sum_nn_ - 2 * r * sum_nd_ + r * r * sum_dd_) / (samples_ - 1);
+    double mean_d = sum_d_ / samples_;
+    double variance = std::max(0.0, residuals) / (samples_ * mean_d * mean_d);
+    return 1.96 * std::sqrt(variance);
+}
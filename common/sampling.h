@@ -0,0 +1,94 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "trace_reader.h"
+
+// Systematic sampling of a trace (SMARTS style): the trace is cut into periods of period records.
+// The first period - warmup - window records of a period are skipped, the next warmup records only
+// update the model state (functional warming), and the last window records are measured.
+// Skipped records cost no simulation, so the run is about period / (warmup + window) times faster.
+struct SamplingPlan {
+    uint64_t period = 0;
+    uint64_t window = 0;
+    uint64_t warmup = 0;
+
+    uint64_t skipped() const { return period - warmup - window; }
+};
+
+// "<period>,<window>[,<warmup>]", without a warmup every record outside the windows warms the
+// model, which is exact state but no faster. Return false if the spec is invalid
+bool parse_sampling_plan(const std::string &spec, SamplingPlan &plan);
+
+// Estimate of a ratio of totals (misses / accesses) from the per window counts.
+// The interval is the normal approximation of the ratio estimator, it needs some 30 windows.
+class RatioEstimate {
+public:
+    void add(double numerator, double denominator);
+
+    size_t samples() const { return samples_; }
+    double ratio() const;
+    // half width of the 95% confidence interval, 0 with fewer than 2 windows
+    double half_width() const;
+
+private:
+    size_t samples_ = 0;
+    double sum_n_ = 0;
+    double sum_d_ = 0;
+    double sum_nn_ = 0;
+    double sum_dd_ = 0;
+    double sum_nd_ = 0;
+};
+
+// Run a trace through a model under plan. simulate(record) is called for every warming and
+// measured record, begin_window() and end_window() around the measured records of each period
+// (a window cut short by the end of the trace still ends). Return the records in the trace.
+template <typename Record, typename Simulate, typename Begin, typename End>
+uint64_t run_sampled(TraceReader &reader, const SamplingPlan &plan, Simulate simulate, Begin begin_window, End end_window) {
+    std::vector<Record> batch(TraceReader::kBatchSize);
+    uint64_t total = 0;
+    // simulate up to count records, return how many the trace had
+    auto run = [&](uint64_t count) {
+        uint64_t done = 0;
+        while (done < count) {
+            size_t max = std::min<uint64_t>(count - done, batch.size());
+            size_t read;
+            if constexpr (std::is_same_v<Record, MemoryRecord>) {
+                read = reader.read_memory(batch.data(), max);
+            } else {
+                read = reader.read_branches(batch.data(), max);
+            }
+            if (read == 0) {
+                break;
+            }
+            for (size_t i = 0; i < read; i++) {
+                simulate(batch[i]);
+            }
+            done += read;
+        }
+        total += done;
+        return done;
+    };
+    while (true) {
+        uint64_t skipped = reader.skip(plan.skipped());
+        total += skipped;
+        if (skipped < plan.skipped() || run(plan.warmup) < plan.warmup) {
+            break;
+        }
+        begin_window();
+        uint64_t measured = run(plan.window);
+        if (measured > 0) {
+            end_window();
+        }
+        if (measured < plan.window) {
+            break;
+        }
+    }
+    return total;
+}
+
+#endif // SAMPLING_H
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <getopt.h>
+#include <format>
+#include <fstream>
+#include <vector>
+#include "trace_reader.h"
+#include "binary_trace.h"
+
+namespace {
+
+void usage(const std::string& program_name) {
+    std::cerr << "Usage: " << program_name << " [-z] <input_trace> <output_trace>" << std::endl
+        << "  a text trace is converted to binary, a binary trace back to text" << std::endl
+        << "  -z  compress the blocks of the binary trace" << std::endl;
+}
+
+// memory traces start with the operation (r/w), branch traces with the pc
+TraceKind detect_kind(const std::string &trace_file) {
+    std::ifstream infile(trace_file);
+    char first = 0;
+    infile >> first;
+    return (first == 'r' || first == 'w') ? TRACE_MEMORY : TRACE_BRANCH;
+}
+
+template <typename Record, typename Emit>
+void for_each_record(TraceReader &reader, size_t (TraceReader::*read)(Record *, size_t), Emit emit) {
+    std::vector<Record> batch(TraceReader::kBatchSize);
+    while (size_t count = (reader.*read)(batch.data(), batch.size())) {
+        for (size_t i = 0; i < count; ++i) {
+            emit(batch[i]);
+        }
+    }
+    if (reader.failed()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+}
+
+void to_binary(TraceReader &reader, TraceKind kind, const std::string &output, bool compress) {
+    BinaryTraceWriter writer(output, kind, compress);
+    if (!writer.is_open()) {
+        std::cerr << "Cannot open " << output << std::endl;
+        exit(1);
+    }
+    if (kind == TRACE_MEMORY) {
+        for_each_record(reader, &TraceReader::read_memory, [&](const MemoryRecord &record) {
+            if (record.op != 'r' && record.op != 'w') {
+                std::cerr << "Invalid operation!" << std::endl;
+                exit(1);
+            }
+            if (record.core != 0) {
+                // binary traces are one core each
+                std::cerr << "Split a multicore trace per core before converting it!" << std::endl;
+                exit(1);
+            }
+            writer.write(record.address, record.op == 'w');
+        });
+    } else {
+        for_each_record(reader, &TraceReader::read_branches, [&](const BranchRecord &record) {
+            writer.write(record.pc, record.taken);
+        });
+    }
+    if (!writer.close()) {
+        std::cerr << "Cannot write " << output << std::endl;
+        exit(1);
+    }
+}
+
+void to_text(TraceReader &reader, TraceKind kind, const std::string &output) {
+    std::ofstream outfile(output);
+    if (!outfile.is_open()) {
+        std::cerr << "Cannot open " << output << std::endl;
+        exit(1);
+    }
+    std::string line;
+    if (kind == TRACE_MEMORY) {
+        for_each_record(reader, &TraceReader::read_memory, [&](const MemoryRecord &record) {
+            line.clear();
+            std::format_to(std::back_inserter(line), "{} {:x}\n", record.op, record.address);
+            outfile << line;
+        });
+    } else {
+        for_each_record(reader, &TraceReader::read_branches, [&](const BranchRecord &record) {
+            line.clear();
+            std::format_to(std::back_inserter(line), "{:x} {}\n", record.pc, record.taken ? 't' : 'n');
+            outfile << line;
+        });
+    }
+    if (!outfile.flush()) {
+        std::cerr << "Cannot write " << output << std::endl;
+        exit(1);
+    }
+}
+
+} // namespace
+
+// ./trace-convert -z ../MachineProblem1/traces/gcc_trace.txt gcc_trace.bin
+
+int main(int argc, char* argv[]) {
+    bool compress = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "hz")) != -1) {
+        switch (opt) {
+            case 'z':
+                compress = true;
+                break;
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+            default:
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+    if (argc - optind != 2) {
+        std::cerr << "Argument count must be 2!" << std::endl;
+        usage(argv[0]);
+        exit(1);
+    }
+    std::string input(argv[optind]);
+    std::string output(argv[optind + 1]);
+
+    TraceReader reader(input);
+    if (!reader.is_open()) {
+        std::cerr << "Invalid trace file!" << std::endl;
+        exit(1);
+    }
+    if (reader.is_binary()) {
+        to_text(reader, reader.kind(), output);
+    } else {
+        to_binary(reader, detect_kind(input), output, compress);
+    }
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include "trace_reader.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char *skip_spaces(const char *p, const char *end) {
+    while (p != end && is_space(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+// return the value of a hex digit, or -1
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20; // lower case
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// parse a hex token starting at p, the token must end at a space or at the end of the line
+bool parse_hex(const char *&p, const char *end, uint64_t &value) {
+    const char *start = p;
+    value = 0;
+    while (p != end && !is_space(*p)) {
+        int digit = hex_value(*p);
+        if (digit < 0 || p - start == 16) {
+            return false;
+        }
+        value = (value << 4) | digit;
+        ++p;
+    }
+    return p != start;
+}
+
+} // namespace
+
+TraceReader::TraceReader(const std::string &path) {
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        return;
+    }
+    size_ = st.st_size;
+    if (size_ != 0) {
+        void *mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapped == MAP_FAILED) {
+            return;
+        }
+        madvise(mapped, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char *>(mapped);
+    }
+    if (is_binary_trace(data_, size_)) {
+        binary_ = true;
+        memcpy(&header_, data_, sizeof(header_));
+        pos_ = sizeof(header_);
+    }
+    open_ = true;
+}
+
+TraceReader::~TraceReader() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char *>(data_), size_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool TraceReader::is_open() const {
+    return open_;
+}
+
+bool TraceReader::is_binary() const {
+    return binary_;
+}
+
+TraceKind TraceReader::kind() const {
+    return static_cast<TraceKind>(header_.kind);
+}
+
+bool TraceReader::failed() const {
+    return failed_;
+}
+
+bool TraceReader::load_block() {
+    uint32_t sizes[2];
+    if (size_ - pos_ < sizeof(sizes)) {
+        failed_ = true;
+        return false;
+    }
+    memcpy(sizes, data_ + pos_, sizeof(sizes));
+    pos_ += sizeof(sizes);
+    // the sizes come from the file: the stored bytes must be in the mapping, and no block decodes
+    // to more than its records can take, or is stored raw in fewer bytes than it decodes from
+    bool compressed = header_.flags & TRACE_COMPRESSED;
+    if (size_ - pos_ < sizes[1] || header_.block_records > kTraceBlockRecords ||
+        sizes[0] > uint64_t(header_.block_records) * kMaxTraceRecordBytes || (!compressed && sizes[0] != sizes[1])) {
+        failed_ = true;
+        return false;
+    }
+    const uint8_t *stored = reinterpret_cast<const uint8_t *>(data_ + pos_);
+    pos_ += sizes[1];
+    if (compressed) {
+        block_.resize(sizes[0]);
+        uLongf raw_size = sizes[0];
+        if (uncompress(block_.data(), &raw_size, stored, sizes[1]) != Z_OK || raw_size != sizes[0]) {
+            failed_ = true;
+            return false;
+        }
+        block_pos_ = block_.data();
+    } else {
+        // uncompressed blocks are decoded straight from the mapping
+        block_pos_ = stored;
+    }
+    block_end_ = block_pos_ + sizes[0];
+    previous_ = 0;
+    return true;
+}
+
+bool TraceReader::next_binary(uint64_t &value, bool &bit) {
+    if (failed_) {
+        return false;
+    }
+    if (block_pos_ == block_end_) {
+        if (pos_ >= size_ || !load_block()) {
+            return false;
+        }
+    }
+    if (!decode_trace_record(block_pos_, block_end_, previous_, value, bit)) {
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool TraceReader::next_line(const char *&begin, const char *&end) {
+    if (failed_ || pos_ >= size_) {
+        return false;
+    }
+    begin = data_ + pos_;
+    // memchr is vectorised in libc, so this is the SIMD newline search
+    const char *newline = static_cast<const char *>(memchr(begin, '\n', size_ - pos_));
+    end = newline != nullptr ? newline : data_ + size_;
+    pos_ = end - data_ + 1;
+    return true;
+}
+
+size_t TraceReader::read_memory(MemoryRecord *records, size_t max) {
+    size_t count = 0;
+    if (binary_) {
+        if (header_.kind != TRACE_MEMORY) {
+            failed_ = true;
+            return 0;
+        }
+        bool write;
+        while (count < max && next_binary(records[count].address, write)) {
+            records[count].op = write ? 'w' : 'r';
+            records[count].core = 0;
+            ++count;
+        }
+        return count;
+    }
+    const char *p;
+    const char *end;
+    while (count < max && next_line(p, end)) {
+        p = skip_spaces(p, end);
+        if (p == end) {
+            failed_ = true;
+            break;
+        }
+        MemoryRecord &record = records[count];
+        record.op = *p++;
+        p = skip_spaces(p, end);
+        if (!parse_hex(p, end, record.address)) {
+            failed_ = true;
+            break;
+        }
+        // optional decimal core id
+        record.core = 0;
+        p = skip_spaces(p, end);
+        for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+            record.core = record.core * 10 + (*p - '0');
+        }
+        ++count;
+    }
+    return count;
+}
+
+size_t TraceReader::read_branches(BranchRecord *records, size_t max) {
+    size_t count = 0;
+    if (binary_) {
+        if (header_.kind != TRACE_BRANCH) {
+            failed_ = true;
+            return 0;
+        }
+        while (count < max && next_binary(records[count].pc, records[count].taken)) {
+            ++count;
+        }
+        return count;
+    }
+    const char *p;
+    const char *end;
+    while (count < max && next_line(p, end)) {
+        BranchRecord &record = records[count];
+        p = skip_spaces(p, end);
+        if (!parse_hex(p, end, record.pc)) {
+            failed_ = true;
+            break;
+        }
+        p = skip_spaces(p, end);
+        const char *outcome = p;
+        while (p != end && !is_space(*p)) {
+            ++p;
+        }
+        if (outcome == p) {
+            failed_ = true;
+            break;
+        }
+        record.taken = (p - outcome == 1 && *outcome == 't');
+        ++count;
+    }
+    return count;
+}
+
+size_t TraceReader::skip(size_t max) {
+    size_t count = 0;
+    if (binary_) {
+        // the addresses are delta encoded, so every record is still decoded
+        uint64_t value;
+        bool bit;
+        while (count < max && next_binary(value, bit)) {
+            ++count;
+        }
+        return count;
+    }
+    const char *begin;
+    const char *end;
+    while (count < max && next_line(begin, end)) {
+        ++count;
+    }
+    return count;
+}
@@ -0,0 +1,75 @@
+#ifndef TRACE_READER_H
+#define TRACE_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "binary_trace.h"
+
+// one line of a memory trace: "r|w <hex address> [<core>]", the core column is for multicore traces
+struct MemoryRecord {
+    char op;
+    uint32_t core;
+    uint64_t address;
+};
+
+// one line of a branch trace: "<hex pc> t|n"
+struct BranchRecord {
+    uint64_t pc;
+    bool taken;
+};
+
+// Reads a text or binary (binary_trace.h) trace through a read-only memory mapping.
+// The format is detected from the header. Records are decoded in place, nothing is
+// allocated per record, and records are handed out in batches.
+class TraceReader {
+public:
+    static constexpr size_t kBatchSize = 4096;
+
+    explicit TraceReader(const std::string &path);
+    ~TraceReader();
+
+    TraceReader(const TraceReader &) = delete;
+    TraceReader &operator=(const TraceReader &) = delete;
+
+    bool is_open() const;
+    bool is_binary() const;
+    // kind from the header of a binary trace
+    TraceKind kind() const;
+
+    // a malformed line stops the reader, the batch returned before it is still valid
+    bool failed() const;
+
+    // parse up to max records into records, return the number parsed, 0 at the end of the trace
+    size_t read_memory(MemoryRecord *records, size_t max);
+    size_t read_branches(BranchRecord *records, size_t max);
+    // pass over up to max records without parsing them, return the number passed over.
+    // A text line is only searched for its end, so a malformed one isn't noticed
+    size_t skip(size_t max);
+
+private:
+    // return the next line without its line terminator, false at the end of the trace
+    bool next_line(const char *&begin, const char *&end);
+
+    // decode the next binary record, false at the end of the trace or on a corrupt block
+    bool next_binary(uint64_t &value, bool &bit);
+    bool load_block();
+
+    int fd_ = -1;
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    size_t pos_ = 0;
+    bool open_ = false;
+    bool failed_ = false;
+
+    // binary traces
+    bool binary_ = false;
+    TraceHeader header_;
+    std::vector<uint8_t> block_;
+    const uint8_t *block_pos_ = nullptr;
+    const uint8_t *block_end_ = nullptr;
+    uint64_t previous_ = 0;
+};
+
+#endif // TRACE_READER_H